@@ -0,0 +1,264 @@
+/*
+ * SchemeDispatcher.cc
+ *
+ * AtomSpace-affine routing of scheme evaluations to worker threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+
+#include <tuple>
+
+#include <opencog/util/platform.h>
+
+#include "SchemeDispatcher.h"
+#include "SchemeEval.h"
+
+using namespace opencog;
+
+SchemeDispatcher::SchemeDispatcher(size_t nthreads, size_t steal_threshold) :
+	_steal_threshold(steal_threshold),
+	_stop(false),
+	_run_local(0),
+	_run_stolen(0)
+{
+	SchemeEval::init_scheme();
+
+	for (size_t i = 0; i < nthreads; i++)
+	{
+		_workers.emplace_back(new Worker);
+		_workers.back()->owned = 0;
+	}
+	for (size_t i = 0; i < nthreads; i++)
+		_threads.emplace_back(&SchemeDispatcher::worker_loop, this, i);
+}
+
+SchemeDispatcher::~SchemeDispatcher()
+{
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		_stop = true;
+	}
+	for (auto& w : _workers) w->cv.notify_all();
+	for (auto& t : _threads) t.join();
+}
+
+/// The worker to give a new AtomSpace to. Must be called with _mtx
+/// held.
+size_t SchemeDispatcher::least_loaded(AtomSpace* as)
+{
+	// The shortest queue. When the queues are equal (as they are when
+	// all are idle), prefer a worker that has run this AtomSpace
+	// before, so that its evaluator is reused; otherwise the one
+	// owning the fewest AtomSpaces, and then the one with the fewest
+	// evaluators, so that new AtomSpaces don't all pile up on the
+	// first worker.
+	auto key = [&](size_t i) {
+		Worker* w = _workers[i].get();
+		return std::make_tuple(w->queue.size(),
+			0 == w->evaluators.count(as), w->owned, w->evaluators.size());
+	};
+
+	size_t best = 0;
+	for (size_t i = 1; i < _workers.size(); i++)
+		if (key(i) < key(best)) best = i;
+	return best;
+}
+
+void SchemeDispatcher::enqueue(AtomSpace* as, Work work, Fail fail)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+
+	auto own = _owner.find(as);
+	if (_owner.end() == own)
+	{
+		size_t best = least_loaded(as);
+		_workers[best]->owned++;
+		own = _owner.emplace(as, Ownership{best, 0, false}).first;
+	}
+	own->second.pending++;
+
+	Worker* w = _workers[own->second.worker].get();
+	w->queue.push_back({as, std::move(work), std::move(fail), false});
+	w->cv.notify_one();
+
+	// If the owner is falling behind, wake the others, to steal.
+	if (_steal_threshold < w->queue.size())
+		for (auto& other : _workers)
+			if (other.get() != w) other->cv.notify_one();
+}
+
+/// Take over one AtomSpace from the longest queue, if that one is
+/// over the steal threshold: the first one queued there that is not
+/// running, along with all of its queued work, in order. Must be
+/// called with _mtx held.
+bool SchemeDispatcher::steal(size_t i)
+{
+	size_t v = 0;
+	for (size_t j = 1; j < _workers.size(); j++)
+		if (_workers[v]->queue.size() < _workers[j]->queue.size())
+			v = j;
+
+	Worker* victim = _workers[v].get();
+	if (v == i or victim->queue.size() <= _steal_threshold)
+		return false;
+
+	AtomSpace* as = nullptr;
+	for (const Task& t : victim->queue)
+		if (not _owner[t.atomspace].running)
+		{
+			as = t.atomspace;
+			break;
+		}
+	if (nullptr == as) return false;
+
+	Worker* self = _workers[i].get();
+	std::deque<Task> keep;
+	for (Task& t : victim->queue)
+	{
+		if (as != t.atomspace)
+		{
+			keep.push_back(std::move(t));
+			continue;
+		}
+		t.stolen = true;
+		self->queue.push_back(std::move(t));
+	}
+	victim->queue.swap(keep);
+
+	_owner[as].worker = i;
+	victim->owned--;
+	self->owned++;
+	return true;
+}
+
+/// Take the next task for worker i: from its own queue, stealing
+/// first if that is empty. Must be called with _mtx held.
+bool SchemeDispatcher::next_task(size_t i, Task& task)
+{
+	Worker* self = _workers[i].get();
+	if (self->queue.empty() and not steal(i))
+		return false;
+
+	task = std::move(self->queue.front());
+	self->queue.pop_front();
+	_owner[task.atomspace].running = true;
+	return true;
+}
+
+/// A task for the AtomSpace has run. Once it has nothing queued, its
+/// owner lets go of it. Must be called with _mtx held.
+void SchemeDispatcher::task_done(AtomSpace* as)
+{
+	auto own = _owner.find(as);
+	own->second.running = false;
+	if (0 < --own->second.pending) return;
+
+	_workers[own->second.worker]->owned--;
+	_owner.erase(own);
+}
+
+void SchemeDispatcher::worker_loop(size_t i)
+{
+	set_thread_name("atoms:dispatch");
+	Worker* self = _workers[i].get();
+
+	while (true)
+	{
+		Task task;
+		{
+			std::unique_lock<std::mutex> lck(_mtx);
+			while (not _stop and not next_task(i, task))
+				self->cv.wait(lck);
+			if (_stop) return;
+
+			if (task.stolen) _run_stolen++;
+			else _run_local++;
+			self->evaluators.insert(task.atomspace);
+		}
+
+		// Exceptions go to whoever is waiting on the result; letting
+		// one out of the thread function would call terminate().
+		try
+		{
+			task.work(SchemeEval::get_evaluator(task.atomspace));
+		}
+		catch (...)
+		{
+			task.fail(std::current_exception());
+		}
+
+		std::lock_guard<std::mutex> lck(_mtx);
+		task_done(task.atomspace);
+	}
+}
+
+std::future<void> SchemeDispatcher::submit(AtomSpace* as, Work work)
+{
+	auto prom = std::make_shared<std::promise<void>>();
+	enqueue(as,
+		[prom, work](SchemeEval* ev) { work(ev); prom->set_value(); },
+		[prom](std::exception_ptr ex) { prom->set_exception(ex); });
+	return prom->get_future();
+}
+
+std::future<ValuePtr> SchemeDispatcher::eval_v(AtomSpace* as,
+                                               const std::string& expr)
+{
+	auto prom = std::make_shared<std::promise<ValuePtr>>();
+	enqueue(as,
+		[prom, expr](SchemeEval* ev)
+		{
+			prom->set_value(ev->eval_v(expr));
+		},
+		[prom](std::exception_ptr ex) { prom->set_exception(ex); });
+	return prom->get_future();
+}
+
+std::future<std::string> SchemeDispatcher::eval(AtomSpace* as,
+                                                const std::string& expr)
+{
+	auto prom = std::make_shared<std::promise<std::string>>();
+	enqueue(as,
+		[prom, expr](SchemeEval* ev)
+		{
+			std::vector<std::string> batch{expr};
+			std::string result;
+			std::vector<size_t> offsets;
+			ev->eval_many(batch, result, offsets);
+			prom->set_value(result);
+		},
+		[prom](std::exception_ptr ex) { prom->set_exception(ex); });
+	return prom->get_future();
+}
+
+std::string SchemeDispatcher::stats(void)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	size_t nevals = 0;
+	for (auto& w : _workers)
+		nevals += w->evaluators.size();
+
+	char buf[200];
+	snprintf(buf, sizeof(buf),
+		"dispatch: %zu atomspaces busy, %zu evaluators on %zu threads, "
+		"%zu run locally, %zu stolen",
+		_owner.size(), nevals, _workers.size(), _run_local, _run_stolen);
+	return buf;
+}
+
+/* ===================== END OF FILE ============================ */
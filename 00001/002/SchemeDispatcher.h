@@ -0,0 +1,135 @@
+/*
+ * SchemeDispatcher.h
+ *
+ * AtomSpace-affine routing of scheme evaluations to worker threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_DISPATCHER_H
+#define _OPENCOG_SCHEME_DISPATCHER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencog/atoms/value/Value.h>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+class AtomSpace;
+class SchemeEval;
+
+/**
+ * Route scheme work for each AtomSpace to the one worker thread that
+ * owns that AtomSpace's evaluator.
+ *
+ * SchemeEval::get_evaluator() hands out one evaluator per (thread,
+ * AtomSpace) pair. When work for one AtomSpace is sprayed across many
+ * threads, each of them builds and keeps warm its own evaluator for
+ * it, and the atomspace fluids keep getting switched. Here, instead,
+ * each AtomSpace with work queued or running is owned by one worker,
+ * and all of its work goes to that worker's queue, to be run in the
+ * order submitted. An AtomSpace is given to the least-loaded worker
+ * (the shortest queue; among equals, one that already has an
+ * evaluator for it, then the one owning the fewest AtomSpaces, then
+ * the one with the fewest evaluators). Ownership is given up when
+ * the AtomSpace's last task has run.
+ *
+ * An idle worker steals from another worker only when that worker's
+ * queue is longer than the steal threshold, and then it steals whole
+ * AtomSpaces: the ownership of one AtomSpace that has work queued,
+ * but none running, along with all of that work. So the work for
+ * one AtomSpace is never reordered, nor run on two threads at once.
+ */
+class SchemeDispatcher
+{
+	private:
+		typedef std::function<void(SchemeEval*)> Work;
+		typedef std::function<void(std::exception_ptr)> Fail;
+		struct Task
+		{
+			AtomSpace* atomspace;
+			Work work;
+			Fail fail;
+			bool stolen;
+		};
+		struct Ownership
+		{
+			size_t worker;
+			size_t pending;   // Tasks queued or running.
+			bool running;
+		};
+		struct Worker
+		{
+			std::deque<Task> queue;
+			std::condition_variable cv;
+			std::set<AtomSpace*> evaluators;
+			size_t owned;
+		};
+
+		size_t _steal_threshold;
+		std::vector<std::unique_ptr<Worker>> _workers;
+		std::vector<std::thread> _threads;
+		std::map<AtomSpace*, Ownership> _owner;
+		std::mutex _mtx;
+		bool _stop;
+
+		size_t _run_local;
+		size_t _run_stolen;
+
+		void enqueue(AtomSpace*, Work, Fail);
+		size_t least_loaded(AtomSpace*);
+		bool steal(size_t);
+		bool next_task(size_t, Task&);
+		void task_done(AtomSpace*);
+		void worker_loop(size_t);
+
+	public:
+		SchemeDispatcher(size_t nthreads, size_t steal_threshold = 8);
+		~SchemeDispatcher();
+
+		/// Queue work for the AtomSpace. The work is handed the
+		/// evaluator to use, on the thread that it runs on. Anything
+		/// that it throws is delivered through the future.
+		std::future<void> submit(AtomSpace*, Work);
+
+		/// Queue an eval_v() of the expression against the AtomSpace.
+		std::future<ValuePtr> eval_v(AtomSpace*, const std::string&);
+
+		/// Queue a shell-style evaluation; see SchemeEval::eval_many().
+		std::future<std::string> eval(AtomSpace*, const std::string&);
+
+		/// Summary of routing effectiveness, for monitoring.
+		std::string stats(void);
+};
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_DISPATCHER_H
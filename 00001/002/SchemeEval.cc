@@ -22,27 +22,50 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <unordered_map>
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <termios.h>
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCHEME_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
 #include <libguile.h>
 #include <libguile/backtrace.h>
 #include <libguile/debug.h>
+#include <gc/gc.h>
 
 #include <opencog/util/platform.h>
 #include <opencog/util/Logger.h>
 #include <opencog/util/oc_assert.h>
 #include <opencog/util/platform.h>
 #include <opencog/atoms/truthvalue/TruthValue.h>
+#include <opencog/atoms/value/FloatValue.h>
 
 #include "SchemeEval.h"
+#include "SchemeGCTrace.h"
+#include "SchemePerf.h"
 #include "SchemePrimitive.h"
+#include "SchemePrepared.h"
 #include "SchemeSmob.h"
+#include "SchemeStream.h"
+#include "SchemeTrace.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -53,8 +76,27 @@ static std::mutex init_mtx;
 
 FILE* fh = nullptr;
 
+// The guile boot thread writes to a trace file of its own, so that it
+// does not depend on some other thread holding `fh` open meanwhile.
+static FILE* boot_fh = nullptr;
+
+static FILE* open_debug_file(void)
+{
+	struct stat sb;
+	if (stat("/storage/emulated/0/Download", &sb) == 0 && S_ISDIR(sb.st_mode))
+		return fopen("/storage/emulated/0/Download/datomspace-test.txt", "a+");
+	return fopen("/storage/sdcard0/Download/datomspace-test.txt", "a+");
+}
+
 static volatile int flush_stdouterr = 0;
 
+static void interrupt_done(SchemeEval*, bool);
+static void eval_thread_begin(SCM&, pthread_t&);
+static void eval_thread_end(SchemeEval*, SCM&);
+static void install_oom_handler(void);
+static void install_define_observer(void);
+static void intern_catch_keys(void);
+
 /**
  * This init is called once for every time that this class
  * is instantiated -- i.e. it is a per-instance initializer.
@@ -91,7 +133,8 @@ void SchemeEval::init(void)
 	_captured_stack = SCM_BOOL_F;
 	_captured_stack = scm_gc_protect_object(_captured_stack);
 
-	_pexpr = NULL;
+	_pexpr = std::string_view();
+	_answer_off = 0;
 	_eval_done = true;
 	_poll_done = true;
 
@@ -99,6 +142,12 @@ void SchemeEval::init(void)
 	_rc = scm_gc_protect_object(_rc);
 
 	_gc_ctr = 0;
+
+	_memoize = false;
+
+	_module = SCM_BOOL_F;
+	_pipeline = nullptr;
+	_structured = false;
 }
 
 /// When the user is using the guile shell from within the cogserver,
@@ -172,7 +221,7 @@ void SchemeEval::redirect_output(void)
 
 	scm_set_current_output_port(_outport);
 
-	_eval_thread = scm_current_thread();
+	eval_thread_begin(_eval_thread, _eval_pthread);
 }
 
 void SchemeEval::restore_output(void)
@@ -185,7 +234,8 @@ void SchemeEval::restore_output(void)
 		scm_set_current_output_port(_saved_outport);
 	scm_gc_unprotect_object(_saved_outport);
 
-	_eval_thread = SCM_EOL;
+	// If an interrupt arrived too late to do anything, forget it.
+	eval_thread_end(this, _eval_thread);
 }
 
 /// Discard all chars in the outport.
@@ -219,6 +269,7 @@ void SchemeEval::finish(void)
 
 	scm_gc_unprotect_object(_scm_error_string);
 	scm_gc_unprotect_object(_captured_stack);
+	set_module(SCM_BOOL_F);
 
 	// Force garbage collection
 	scm_gc();
@@ -241,6 +292,14 @@ void SchemeEval::set_captured_stack(SCM newstack)
 	scm_gc_unprotect_object(oldstack);
 }
 
+void SchemeEval::set_module(SCM newmodule)
+{
+	SCM oldmodule = _module;
+	_module = newmodule;
+	if (scm_is_true(newmodule)) scm_gc_protect_object(newmodule);
+	if (scm_is_true(oldmodule)) scm_gc_unprotect_object(oldmodule);
+}
+
 void SchemeEval::set_error_string(SCM newerror)
 {
 	SCM olderror = _scm_error_string;
@@ -267,16 +326,268 @@ static SCM throw_except(void)
 
 static SCM throw_thunk = SCM_EOL;
 
+static SCM ss_value_to_f64vector(SCM);
+static SCM ss_f64vector_to_value(SCM);
+
+// Autoloading of OpenCog scheme modules. Rather than loading all of
+// the modules (and their C++ primitive sets) up front, each binding
+// that a module provides is registered as an autoload stub in the
+// top-level environment: the first reference to any one of them loads
+// the providing module, from its installed, compiled .go file. Startup
+// cost and resident memory then scale with what is actually used.
+//
+// Which module provides which bindings is not compiled in: each
+// package installs a manifest, opencog/autoload.scm, somewhere on the
+// guile %load-path, listing its own modules, e.g.
+//    ((opencog exec) cog-execute! cog-evaluate!)
+// and every such manifest found is read. Deployments can add entries
+// of the same form in a file named by the COG_AUTOLOAD_MANIFEST
+// environment variable.
+#define AUTOLOAD_MANIFEST "opencog/autoload.scm"
+
+static SCM autoload_entries(SCM entries)
+{
+	SCM autoload = scm_variable_ref(scm_c_lookup("module-autoload!"));
+	SCM module = scm_current_module();
+	for (; scm_is_pair(entries); entries = SCM_CDR(entries))
+	{
+		SCM ent = SCM_CAR(entries);
+		if (not scm_is_pair(ent)) continue;
+		scm_call_3(autoload, module, SCM_CAR(ent), SCM_CDR(ent));
+	}
+	return SCM_BOOL_T;
+}
+
+static SCM read_manifest_file(void* path)
+{
+	SCM port = scm_open_file(scm_from_utf8_string((const char*) path),
+	                         scm_from_utf8_string("r"));
+	SCM entries = SCM_EOL;
+	for (SCM ent = scm_read(port); not SCM_EOF_OBJECT_P(ent);
+	     ent = scm_read(port))
+		entries = scm_cons(ent, entries);
+	scm_close_port(port);
+	return autoload_entries(entries);
+}
+
+static SCM bad_manifest_file(void* path, SCM tag, SCM throw_args)
+{
+	logger().warn("[SchemeEval] Unable to read autoload manifest %s",
+	              (const char*) path);
+	return SCM_BOOL_F;
+}
+
+/* ============================================================== */
+/* Lazily defined C++ primitive sets. */
+
+static void define_f64vector_bridge(void)
+{
+	scm_c_define_gsubr("cog-value->f64vector",
+		1, 0, 0, ((scm_t_subr) ss_value_to_f64vector));
+	scm_c_define_gsubr("cog-f64vector->value",
+		1, 0, 0, ((scm_t_subr) ss_f64vector_to_value));
+}
+
+// A C++ primitive set. It is defined only when one of its bindings is
+// first looked up; see lazy_binder().
+struct PrimitiveSet
+{
+	void (*define)(void);
+	enum { UNDEFINED, DEFINING, DEFINED } state;
+	std::thread::id definer;
+};
+
+static std::mutex lazy_mtx;
+static std::condition_variable lazy_cv;
+
+// The registered sets, and binding name -> index into them. These are
+// function-local, because other translation units register their sets
+// from static constructors, in no particular order with ours.
+static std::deque<PrimitiveSet>& primitive_sets(void)
+{
+	static std::deque<PrimitiveSet> sets;
+	return sets;
+}
+
+static std::unordered_map<std::string, size_t>& lazy_bindings(void)
+{
+	static std::unordered_map<std::string, size_t> bindings;
+	return bindings;
+}
+
+/// Register a set of C++ primitives, to be defined (in a module that
+/// is visible from the top-level environment) the first time that any
+/// one of the named bindings is looked up. This may be called at any
+/// time, including from static constructors, before guile boots.
+void SchemeEval::register_primitives(void (*define)(void),
+                                     std::initializer_list<const char*> names)
+{
+	std::lock_guard<std::mutex> lck(lazy_mtx);
+	std::deque<PrimitiveSet>& sets = primitive_sets();
+	sets.push_back({define, PrimitiveSet::UNDEFINED, std::thread::id()});
+	for (const char* name : names)
+		lazy_bindings()[name] = sets.size() - 1;
+}
+
+static __attribute__((constructor)) void register_eval_primitives(void)
+{
+	SchemeEval::register_primitives(define_f64vector_bridge,
+		{"cog-value->f64vector", "cog-f64vector->value"});
+}
+
+struct LazyDefine
+{
+	SCM module;
+	PrimitiveSet* set;
+};
+
+static SCM define_in_module(void* p)
+{
+	((PrimitiveSet*) p)->define();
+	return SCM_UNSPECIFIED;
+}
+
+static SCM define_primitive_set(void* p)
+{
+	LazyDefine* ld = (LazyDefine*) p;
+	scm_c_call_with_current_module(ld->module, define_in_module, ld->set);
+	return SCM_BOOL_T;
+}
+
+static SCM lazy_define_failed(void*, SCM key, SCM)
+{
+	logger().warn("[SchemeEval] Unable to define primitive set: %s",
+	              SchemeEval::prt(key).c_str());
+	return SCM_BOOL_F;
+}
+
+// The binder of the module that holds the primitive sets. Guile calls
+// it for every symbol that is not (yet) bound in that module, when
+// looking up a name that is not bound in the top-level environment
+// either. The set that provides the name is defined, in the module,
+// and the new binding is returned. Anything else is left unbound.
+//
+// No lock is held while calling into guile: defining one set may look
+// up the bindings of another, re-entering the binder, and a failed
+// definition throws. A thread that wants a set that another thread is
+// busy defining waits for it; the defining thread itself, should it
+// look up one of the set's own names, just gets whatever is bound so
+// far.
+static SCM lazy_binder(SCM module, SCM sym, SCM define_p)
+{
+	size_t len;
+	char* cname = scm_to_utf8_stringn(scm_symbol_to_string(sym), &len);
+	std::string name(cname, len);
+	free(cname);
+
+	LazyDefine ld = {module, nullptr};
+	bool claimed = false;
+	{
+		std::unique_lock<std::mutex> lck(lazy_mtx);
+		auto it = lazy_bindings().find(name);
+		if (lazy_bindings().end() == it) return SCM_BOOL_F;
+		ld.set = &primitive_sets()[it->second];
+
+		while (PrimitiveSet::DEFINING == ld.set->state and
+		       std::this_thread::get_id() != ld.set->definer)
+			lazy_cv.wait(lck);
+
+		if (PrimitiveSet::UNDEFINED == ld.set->state)
+		{
+			ld.set->state = PrimitiveSet::DEFINING;
+			ld.set->definer = std::this_thread::get_id();
+			claimed = true;
+		}
+	}
+
+	if (claimed)
+	{
+		SCM ok = scm_internal_catch(SCM_BOOL_T,
+			define_primitive_set, &ld, lazy_define_failed, nullptr);
+		std::lock_guard<std::mutex> lck(lazy_mtx);
+		ld.set->state = scm_is_true(ok) ?
+			PrimitiveSet::DEFINED : PrimitiveSet::UNDEFINED;
+		lazy_cv.notify_all();
+	}
+	return scm_hashq_ref(SCM_MODULE_OBARRAY(module), sym, SCM_BOOL_F);
+}
+
+// Create an empty module whose binder defines the primitive sets on
+// demand, and make it visible from the top-level environment.
+static void install_lazy_primitives(void)
+{
+	SCM module = scm_call_0(scm_variable_ref(scm_c_lookup("make-module")));
+	SCM binder = scm_c_make_gsubr("cog-lazy-binder",
+		3, 0, 0, (scm_t_subr) lazy_binder);
+	scm_call_2(scm_variable_ref(scm_c_lookup("set-module-binder!")),
+		module, binder);
+	scm_call_2(scm_variable_ref(scm_c_lookup("module-use!")),
+		scm_current_module(), module);
+}
+
+static void install_autoloads(void)
+{
+	install_lazy_primitives();
+
+	// Every package's manifest, wherever on the load path it is.
+	SCM dirs = scm_variable_ref(scm_c_lookup("%load-path"));
+	for (; scm_is_pair(dirs); dirs = SCM_CDR(dirs))
+	{
+		if (not scm_is_string(SCM_CAR(dirs))) continue;
+		char* dir = scm_to_utf8_string(SCM_CAR(dirs));
+		std::string manifest = std::string(dir) + "/" AUTOLOAD_MANIFEST;
+		free(dir);
+		if (0 != access(manifest.c_str(), R_OK)) continue;
+		scm_internal_catch(SCM_BOOL_T,
+		                   read_manifest_file, (void*) manifest.c_str(),
+		                   bad_manifest_file, (void*) manifest.c_str());
+	}
+
+	const char* path = getenv("COG_AUTOLOAD_MANIFEST");
+	if (nullptr == path) return;
+	scm_internal_catch(SCM_BOOL_T,
+	                   read_manifest_file, (void*) path,
+	                   bad_manifest_file, (void*) path);
+}
+
 void* c_wrap_init_only_once(void* p)
 {
-fprintf(fh, "duude enter cwrap_niit_only_once tid=%d\n", gettid());
-fflush(fh);
+if (boot_fh) {
+fprintf(boot_fh, "duude enter cwrap_niit_only_once tid=%d\n", gettid());
+fflush(boot_fh);
+}
 
 	throw_thunk = scm_c_make_gsubr("cog-throw-user-interrupt",
 		0, 0, 0, ((scm_t_subr) throw_except));
 
-fprintf(fh, "duude exit cwrap_niit_only_once tid=%d\n", gettid());
-fflush(fh);
+	intern_catch_keys();
+	install_autoloads();
+	install_define_observer();
+	install_oom_handler();
+	SchemeGCTrace::install();
+
+	const char* trace = getenv("COG_SCHEME_TRACE");
+	if (trace)
+		SchemeTrace::start(trace);
+
+	if (getenv("COG_SCHEME_PERF"))
+		SchemePerf::enable(true);
+
+	const char* cache_dir = getenv("COG_EVAL_CACHE_DIR");
+	if (cache_dir)
+		SchemeEval::set_eval_cache(cache_dir);
+
+	const char* log_sample = getenv("COG_EVAL_LOG_SAMPLE");
+	const char* log_rate = getenv("COG_EVAL_LOG_RATE");
+	if (log_sample or log_rate)
+		SchemeEval::set_output_logging(
+			log_sample ? atoi(log_sample) : 1,
+			log_rate ? atoi(log_rate) : 100);
+
+if (boot_fh) {
+fprintf(boot_fh, "duude exit cwrap_niit_only_once tid=%d\n", gettid());
+fflush(boot_fh);
+}
 
 	return nullptr;
 }
@@ -291,10 +602,72 @@ static void flush_stdouterr_thread(void) {
 
 static volatile bool done_with_init = false;
 
+// Wall-clock time spent booting guile (scm_i_init_guile, boot-9 and
+// our own once-only init), in microseconds.
+static int64_t guile_boot_usec = 0;
+
+// Initial size of the bdwgc heap. The default is tiny, and so the
+// guile boot sequence triggers a long string of collections before
+// the heap has grown to its working size; on slow armv7 devices
+// those collections dominate the startup time. Starting out with a
+// heap big enough for boot-9 plus the opencog modules avoids them.
+// The default can be changed at build time, or at run time, with
+// set_startup_heap() or by setting GC_INITIAL_HEAP_SIZE.
+#ifndef SCHEME_STARTUP_HEAP_SIZE
+#define SCHEME_STARTUP_HEAP_SIZE (32*1024*1024)
+#endif
+static size_t startup_heap_size = SCHEME_STARTUP_HEAP_SIZE;
+
+/// Set the initial size of the guile heap, in bytes; zero leaves it
+/// at the bdwgc default. This has an effect only if it is called
+/// before guile boots, i.e. before prewarm(), init_scheme() or the
+/// first evaluator; and not at all if GC_INITIAL_HEAP_SIZE is set in
+/// the environment.
+void SchemeEval::set_startup_heap(size_t bytes)
+{
+	startup_heap_size = bytes;
+}
+
+/// Whether guile may look for scheme source to auto-compile while it
+/// boots. By default, this is left to guile, and to the user's own
+/// GUILE_AUTO_COMPILE setting. Passing false, before guile boots,
+/// presets GUILE_AUTO_COMPILE=0 (unless the user has set it): the boot
+/// files and the opencog modules are installed already compiled, so
+/// stat'ing their sources is wasted time. This changes the environment
+/// of the whole process, and of its children, so it is up to the
+/// embedding application to ask for it.
+static bool boot_auto_compile = true;
+
+void SchemeEval::set_auto_compile(bool enable)
+{
+	boot_auto_compile = enable;
+}
+
+// Settings that must be made before guile is first entered, because
+// bdwgc and guile only look at them while booting. Anything that the
+// user has already set in the environment is left alone; that is what
+// the zero `overwrite` argument to setenv() does.
+static void preset_boot_environment(void)
+{
+	if (0 < startup_heap_size)
+	{
+		char heap[32];
+		snprintf(heap, sizeof(heap), "%zu", startup_heap_size);
+		setenv("GC_INITIAL_HEAP_SIZE", heap, 0);
+	}
+
+	if (not boot_auto_compile)
+		setenv("GUILE_AUTO_COMPILE", "0", 0);
+}
+
 static void immortal_thread(void)
 {
-fprintf(fh, "duude enter immortal tid=%d\n", gettid());
-fflush(fh);
+	boot_fh = open_debug_file();
+
+if (boot_fh) {
+fprintf(boot_fh, "duude enter immortal tid=%d\n", gettid());
+fflush(boot_fh);
+}
 
 struct stat sb;
 if (stat("/storage/emulated/0/Download", &sb) == 0 && S_ISDIR(sb.st_mode)) {
@@ -309,20 +682,31 @@ if (stat("/storage/emulated/0/Download", &sb) == 0 && S_ISDIR(sb.st_mode)) {
 flush_stdouterr = 0;
 new std::thread(flush_stdouterr_thread);
 
-fprintf(fh, "redirect stdout & stderr to file ... done\n");
-fflush(fh);
+if (boot_fh) {
+fprintf(boot_fh, "redirect stdout & stderr to file ... done\n");
+fflush(boot_fh);
+}
 
 printf("redirect stdout & stderr to file ... done\n");
 
-fprintf(fh, "try to write to stdout ... done\n");
-fflush(fh);
+if (boot_fh) {
+fprintf(boot_fh, "try to write to stdout ... done\n");
+fflush(boot_fh);
+}
 
+	auto start = std::chrono::steady_clock::now();
 	scm_with_guile(c_wrap_init_only_once, NULL);
 	set_thread_name("atoms:immortal");
+	guile_boot_usec = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
 
 flush_stdouterr = 1;
-fprintf(fh, "duude immortal done with guile init tid=%d\n", gettid());
-fflush(fh);
+if (boot_fh) {
+fprintf(boot_fh, "duude immortal done with guile init tid=%d usec=%ld\n",
+        gettid(), (long) guile_boot_usec);
+fclose(boot_fh);
+boot_fh = nullptr;
+}
 
 	// Tell compiler to set flag dead-last, after above has executed.
 	asm volatile("": : :"memory");
@@ -332,6 +716,28 @@ fflush(fh);
 	while (true) { pause(); }
 }
 
+// Start booting guile in the immortal thread, if that has not been
+// done yet. Does not wait for the boot to finish.
+static void start_immortal(void)
+{
+	if (not eval_is_inited.test_and_set())
+	{
+if (fh) {
+fprintf(fh, "duude init_only_once gonna make immortal me=%d\n", gettid());
+fflush(fh);
+}
+
+		preset_boot_environment();
+		new std::thread(immortal_thread);
+
+if (fh) {
+fprintf(fh, "duude init_only_once done make immortal me=%d\n", gettid());
+fflush(fh);
+}
+
+	}
+}
+
 // Initialization that needs to be performed only once, for the entire
 // process.
 static void init_only_once(void)
@@ -350,28 +756,11 @@ fflush(fh);
 	// state.  This is documented in two related bugs:
 	// https://debbugs.gnu.org/cgi/bugreport.cgi?bug=26711  and
 	// https://github.com/opencog/atomspace/issues/1054
-	if (not eval_is_inited.test_and_set())
-	{
-fprintf(fh, "duude init_only_once gonna make immortal me=%d\n", gettid());
-fflush(fh);
-
-		new std::thread(immortal_thread);
-
-fprintf(fh, "duude init_only_once done make immortal me=%d\n", gettid());
-fflush(fh);
-
-	}
+	start_immortal();
 
 	while (not done_with_init) { usleep(1000); }
 
-if (nullptr == fh) {
-struct stat sb;
-if (stat("/storage/emulated/0/Download", &sb) == 0 && S_ISDIR(sb.st_mode)) {
-    fh = fopen ("/storage/emulated/0/Download/datomspace-test.txt", "a+");
-} else {
-    fh = fopen ("/storage/sdcard0/Download/datomspace-test.txt", "a+");
-}
-}
+if (nullptr == fh) fh = open_debug_file();
 
 fprintf(fh, "duude return from init_only_once me=%d\n", gettid());
 fflush(fh);
@@ -380,14 +769,7 @@ fflush(fh);
 
 SchemeEval::SchemeEval(AtomSpace* as)
 {
-if (nullptr == fh) {
-struct stat sb;
-if (stat("/storage/emulated/0/Download", &sb) == 0 && S_ISDIR(sb.st_mode)) {
-    fh = fopen ("/storage/emulated/0/Download/datomspace-test.txt", "a+");
-} else {
-    fh = fopen ("/storage/sdcard0/Download/datomspace-test.txt", "a+");
-}
-}
+if (nullptr == fh) fh = open_debug_file();
 fprintf(fh, "duude enter SchemeEval() ctor tid=%d this=%p as=%p\n", gettid(), this, as);
 if(as) {
 fprintf(fh, "duuude ctor as use-count=%lu\n", as->Atom::get_handle().use_count());
@@ -410,14 +792,7 @@ fh = nullptr;
 
 SchemeEval::SchemeEval(AtomSpacePtr& as)
 {
-if (nullptr == fh) {
-struct stat sb;
-if (stat("/storage/emulated/0/Download", &sb) == 0 && S_ISDIR(sb.st_mode)) {
-    fh = fopen ("/storage/emulated/0/Download/datomspace-test.txt", "a+");
-} else {
-    fh = fopen ("/storage/sdcard0/Download/datomspace-test.txt", "a+");
-}
-}
+if (nullptr == fh) fh = open_debug_file();
 
 fprintf(fh, "duude enter SchemeEval(ptr) ctor tid=%d this=%p as=%p\n", gettid(), this, as.get());
 fprintf(fh, "duuude ctor ptr-as use-count=%lu\n", as.use_count());
@@ -442,6 +817,7 @@ void SchemeEval::per_thread_init(void)
 	/* Avoid more than one call per thread. */
 	if (thread_is_inited) return;
 	thread_is_inited = true;
+	SchemeTrace::Span span("per_thread_init");
 
 #ifdef WORK_AROUND_GUILE_UTF8_BUGS
 	// Arghhh!  Avoid ongoing utf8 fruitcake nutiness in guile-2.0
@@ -455,12 +831,115 @@ SchemeEval::~SchemeEval()
 {
 fprintf(fh, "duude enter SchemeEval dtor tid=%d this=%p as=%p\n", gettid(), this, _atomspace);
 
+	interrupt_done(this, false);
+	stop_pipeline();
+	SchemePerf::forget(this);
 	scm_with_guile(c_wrap_finish, this);
 
 fprintf(fh, "duude exit SchemeEval dtor tid=%d this=%p\n", gettid(), this);
 
 }
 
+/* ============================================================== */
+/* String conversion. */
+
+// Strings shorter than this many characters are encoded straight into
+// the caller's buffer; see scm_append_utf8().
+#ifndef SCM_UTF8_DIRECT_MAX
+#define SCM_UTF8_DIRECT_MAX 256
+#endif
+
+static inline void append_utf8_char(std::string& out, scm_t_wchar c)
+{
+	if (c < 0x80)
+		out.push_back((char) c);
+	else if (c < 0x800)
+	{
+		out.push_back((char) (0xc0 | (c >> 6)));
+		out.push_back((char) (0x80 | (c & 0x3f)));
+	}
+	else if (c < 0x10000)
+	{
+		out.push_back((char) (0xe0 | (c >> 12)));
+		out.push_back((char) (0x80 | ((c >> 6) & 0x3f)));
+		out.push_back((char) (0x80 | (c & 0x3f)));
+	}
+	else
+	{
+		out.push_back((char) (0xf0 | (c >> 18)));
+		out.push_back((char) (0x80 | ((c >> 12) & 0x3f)));
+		out.push_back((char) (0x80 | ((c >> 6) & 0x3f)));
+		out.push_back((char) (0x80 | (c & 0x3f)));
+	}
+}
+
+/// Append the UTF-8 encoding of the scheme string to `out`.
+/// Guile has no public way to get at the characters of a string in
+/// place (scm_i_string_chars() is hidden). Short strings -- keys,
+/// symbols, most printed values -- are read a character at a time
+/// with scm_c_string_ref(), which returns an immediate, and encoded
+/// into `out`: no heap allocation, other than `out` growing. Longer
+/// strings are encoded in bulk, through one malloc'ed buffer of known
+/// length, whose cost is small next to that of the copy itself. Either
+/// way, the copy stays out of the GC heap: scm_string_to_utf8() would
+/// make a bytevector that is garbage as soon as it has been read.
+static void scm_append_utf8(SCM str, std::string& out)
+{
+	size_t nchars = scm_c_string_length(str);
+	if (nchars < SCM_UTF8_DIRECT_MAX)
+	{
+		for (size_t i = 0; i < nchars; i++)
+			append_utf8_char(out, SCM_CHAR(scm_c_string_ref(str, i)));
+		return;
+	}
+
+	size_t len;
+	char* buf = scm_to_utf8_stringn(str, &len);
+	out.append(buf, len);
+	free(buf);
+}
+
+/// The UTF-8 encoding of the scheme string, in a buffer owned by this
+/// thread. The view is valid until the next call, on this thread.
+static std::string_view scm_to_utf8_view(SCM str)
+{
+	static thread_local std::string buf;
+	buf.clear();
+	scm_append_utf8(str, buf);
+	return buf;
+}
+
+/* ============================================================== */
+/* Tracing of guile entry. */
+
+struct GuileEntry
+{
+	void* (*func)(void*);
+	void* data;
+	int64_t start;
+};
+
+static void* c_wrap_traced(void* p)
+{
+	GuileEntry* ge = (GuileEntry*) p;
+	SchemeTrace::complete("scm_with_guile", ge->start,
+	                      SchemeTrace::now_usec() - ge->start);
+	return ge->func(ge->data);
+}
+
+/// Same as scm_with_guile(), but when tracing, record a span for the
+/// whole call, and one for the time it took just to get into guile.
+static void* traced_with_guile(const char* name,
+                               void* (*func)(void*), void* data)
+{
+	if (not SchemeTrace::enabled())
+		return scm_with_guile(func, data);
+
+	SchemeTrace::Span span(name);
+	GuileEntry ge{func, data, SchemeTrace::now_usec()};
+	return scm_with_guile(c_wrap_traced, &ge);
+}
+
 /* ============================================================== */
 
 std::string SchemeEval::prt(SCM node)
@@ -476,12 +955,11 @@ std::string SchemeEval::prt(SCM node)
 	else
 	{
 		// Let SCM display do the rest of the work.
+		SchemeTrace::Span span("prt");
 		SCM port = scm_open_output_string();
 		scm_display (node, port);
-		SCM rc = scm_get_output_string(port);
-		char * str = scm_to_utf8_string(rc);
-		std::string rv = str;
-		free(str);
+		std::string rv;
+		scm_append_utf8(scm_get_output_string(port), rv);
 		scm_close_port(port);
 		return rv;
 	}
@@ -512,27 +990,38 @@ SCM SchemeEval::preunwind_handler (SCM tag, SCM throw_args)
 	return SCM_EOL;
 }
 
+// The throw keys that catch_handler() treats specially, interned once,
+// so that they can be told apart by comparing pointers, without
+// converting the key to a string on every throw.
+static SCM key_read_error = SCM_BOOL_F;
+static SCM key_cog_yield = SCM_BOOL_F;
+static SCM key_quit = SCM_BOOL_F;
+static SCM key_user_interrupt = SCM_BOOL_F;
+
+static void intern_catch_keys(void)
+{
+	key_read_error = scm_gc_protect_object(scm_from_utf8_symbol("read-error"));
+	key_cog_yield = scm_gc_protect_object(scm_from_utf8_symbol("cog-yield"));
+	key_quit = scm_gc_protect_object(scm_from_utf8_symbol("quit"));
+	key_user_interrupt = scm_gc_protect_object(
+		scm_from_utf8_symbol("user-interrupt"));
+}
+
 SCM SchemeEval::catch_handler (SCM tag, SCM throw_args)
 {
 	// Check for read error. If a read error, then wait for user to correct it.
-	SCM re = scm_symbol_to_string(tag);
-	char * restr = scm_to_utf8_string(re);
 	_pending_input = false;
 
-	if (0 == strcmp(restr, "read-error"))
+	if (scm_is_eq(tag, key_read_error))
 	{
 		_pending_input = true;
-		free(restr);
 		return SCM_EOL;
 	}
 
 	// Check for a simple flow-control directive: i.e. just return to
 	// the C code from anywhere within the scheme code.
-	if (0 == strcmp(restr, "cog-yield"))
-	{
-		free(restr);
+	if (scm_is_eq(tag, key_cog_yield))
 		return SCM_CAR(throw_args);
-	}
 
 	// If the user types (quit) or (exit) at the cogserver shell, we will
 	// end up here. That's because (quit) (exit) and (exit 42) all get
@@ -544,7 +1033,7 @@ SCM SchemeEval::catch_handler (SCM tag, SCM throw_args)
 	// However, we do one important thing: the guile repl loop does
 	// mess with the termios settings and mangles the shell. So we
 	// do a minimalist `stty sane` here.
-	if (0 == strcmp(restr, "quit"))
+	if (scm_is_eq(tag, key_quit))
 	{
 		logger().info("[SchemeEval]: exit\n");
 
@@ -561,7 +1050,7 @@ SCM SchemeEval::catch_handler (SCM tag, SCM throw_args)
 
 		tcsetattr(STDIN_FILENO, TCSADRAIN, &tio);
 
-		scm_throw(scm_from_utf8_symbol("quit"), throw_args);
+		scm_throw(key_quit, throw_args);
 
 		// The above should not return.  It should have done this:
 		if (SCM_EOL == throw_args) exit(0);
@@ -573,9 +1062,14 @@ SCM SchemeEval::catch_handler (SCM tag, SCM throw_args)
 		exit(1);
 	}
 
+	if (scm_is_eq(tag, key_user_interrupt))
+		interrupt_done(this, true);
+
 	// If it's not a read error, and it's not flow-control,
 	// then its a regular error; report it.
 	_caught_error = true;
+	_error_key.clear();
+	scm_append_utf8(scm_symbol_to_string(tag), _error_key);
 
 	/* get string port into which we write the error message and stack. */
 	SCM port = scm_open_output_string();
@@ -621,8 +1115,7 @@ SCM SchemeEval::catch_handler (SCM tag, SCM throw_args)
 		scm_puts ("ERROR: throw args are unexpectedly short!\n", port);
 	}
 	scm_puts("ABORT: ", port);
-	scm_puts(restr, port);
-	free(restr);
+	scm_display(tag, port);
 
 	set_error_string(scm_get_output_string(port));
 	scm_close_port(port);
@@ -630,87 +1123,484 @@ SCM SchemeEval::catch_handler (SCM tag, SCM throw_args)
 }
 
 /* ============================================================== */
-/**
- * Evaluate a scheme expression.
- *
- * This evaluator is tailored for being invoked by a shell, in several
- * different ways:
- *
- * 1) It buffers up incomplete, line-by-line input, until there's
- *    been enough input received to evaluate without error.
- * 2) It catches errors, and prints the catch in a reasonably nicely
- *    formatted way.
- * 3) It converts any returned scheme expressions to a string, for easy
- *    printing.
- * 4) It concatenates any data sent to the scheme output port (e.g.
- *    printed output from the scheme (display) function) to the returned
- *    string.
- *
- * An "unforgiving" evaluator, with none of these amenities, can be
- * found in eval_v(), below.
- */
-void SchemeEval::eval_expr(const std::string &expr)
+/* Out-of-memory handling. */
+
+// Upper limit on the size of the bdwgc heap, in bytes; zero means no
+// limit. Set from COG_SCHEME_HEAP_LIMIT, or set_heap_limit().
+static size_t heap_limit = 0;
+
+// Size of the low-memory reserve: a block that is held back from the
+// heap, and given up when an allocation fails, so that the failing
+// evaluation has room to unwind and report the error.
+static size_t oom_reserve_size = SCHEME_OOM_RESERVE;
+
+static std::mutex oom_mtx;
+static void* oom_reserve = nullptr;
+static GC_oom_func prev_oom_fn = nullptr;
+static std::atomic<size_t> oom_count(0);
+
+// Set when the reserve has been given up, and not yet put back.
+static std::atomic<bool> oom_reserve_spent(false);
+
+// Depth of evaluations on this thread that are inside a catch that
+// will report an error; only these can be aborted on out-of-memory.
+static thread_local int oom_guard_depth = 0;
+
+// Called by bdwgc when the heap cannot be grown. bdwgc drops its
+// allocation lock before calling this, so it is safe to throw from
+// here, just as a primitive throws a wrong-type-arg from the middle of
+// its work. Inside an evaluation, the reserve is given up, so that the
+// unwind and the error report have room, and guile's preallocated
+// 'out-of-memory error is thrown. Guile throws it without running
+// pre-unwind handlers, so there is no backtrace, but it is caught by
+// the catch in do_eval() or do_scm_eval(), and reported like any other
+// error, as "ABORT: out-of-memory". Outside of an
+// evaluation, the failure is handed on to guile's own handler.
+static void* cog_oom_fn(size_t nbytes)
 {
-	// If we are recursing, then we already are in the guile
-	// environment, and don't need to do any additional setup.
-	// Just go.
-	if (_in_eval) {
-		do_eval(expr);
-		return;
-	}
+	if (0 == oom_guard_depth)
+		return prev_oom_fn ? prev_oom_fn(nbytes) : nullptr;
 
-	_pexpr = &expr;
-	_in_shell = true;
-	_in_eval = true;
-	scm_with_guile(c_wrap_eval, this);
-	_in_eval = false;
-	_in_shell = false;
+	{
+		std::lock_guard<std::mutex> lck(oom_mtx);
+		if (oom_reserve)
+		{
+			GC_free(oom_reserve);
+			oom_reserve = nullptr;
+			oom_reserve_spent = true;
+		}
+		oom_count++;
+	}
+	scm_report_out_of_memory();
+	return nullptr;
 }
 
-void* SchemeEval::c_wrap_poll(void* p)
+static void rearm_oom_reserve(void)
 {
-	SchemeEval* self = (SchemeEval*) p;
-	self->_answer = self->do_poll_result();
-	return p;
+	std::lock_guard<std::mutex> lck(oom_mtx);
+	if (oom_reserve or 0 == oom_reserve_size) return;
+	oom_reserve = GC_malloc_atomic_uncollectable(oom_reserve_size);
+	oom_reserve_spent = (nullptr == oom_reserve);
 }
 
-std::string SchemeEval::poll_result()
+static void install_oom_handler(void)
 {
-	scm_with_guile(c_wrap_poll, this);
-	return _answer;
+	const char* limit = getenv("COG_SCHEME_HEAP_LIMIT");
+	if (limit)
+		SchemeEval::set_heap_limit(strtoull(limit, nullptr, 0));
+
+	prev_oom_fn = GC_get_oom_fn();
+	GC_set_oom_fn(cog_oom_fn);
+	rearm_oom_reserve();
 }
 
-void* SchemeEval::c_wrap_eval(void* p)
+static inline void oom_enter(void)
 {
-	SchemeEval* self = (SchemeEval*) p;
+	oom_guard_depth++;
+}
 
-	// Normally, neither of these are ever null.
-	// But sometimes, a heavily loaded server can crash here.
-	// Trying to figure out why ...
-	OC_ASSERT(self, "c_wrap_eval got null pointer!");
-	OC_ASSERT(self->_pexpr, "c_wrap_eval got null expression!");
+// If an allocation failure used up the reserve, collect the garbage
+// left behind by the aborted evaluation, and set the reserve aside
+// again, before taking on more work.
+static inline void oom_leave(void)
+{
+	if (0 < --oom_guard_depth or not oom_reserve_spent.load()) return;
 
-	self->do_eval(*(self->_pexpr));
-	return self;
+	logger().warn("[SchemeEval] Out of memory; evaluation aborted "
+	              "(%zu so far)\n", oom_count.load());
+	scm_gc();
+	rearm_oom_reserve();
 }
 
-/// Ad hoc hack to try to limit guile memory consumption, while still
-/// providing decent performance.  The problem addressed here is that
-/// guile can get piggy with the system RAM, happily gobbling up RAM
-/// instead of garbage-collecting it.  Users have noticed. See github
-/// issue #1116. This improves on the original pull request #1117.
-/// Clue: bug report #1419 suggests the problem is related to the
-/// do_async_output flag-- setting it to false avoids the blow-up.
-/// Is there an i/o-related leak or weird reserve bug?
-static void do_gc(void)
+/// Set a ceiling on the size of the guile heap, in bytes (zero for
+/// no ceiling), and the size of the low-memory reserve. An evaluation
+/// that runs into the ceiling is aborted with an out-of-memory error,
+/// instead of taking down the process.
+void SchemeEval::set_heap_limit(size_t limit, size_t reserve)
 {
-	static size_t prev_usage = 0;
+	heap_limit = limit;
+	GC_set_max_heap_size(limit);
+
+	std::lock_guard<std::mutex> lck(oom_mtx);
+	if (reserve == oom_reserve_size) return;
+	if (oom_reserve) GC_free(oom_reserve);
+	oom_reserve = nullptr;
+	oom_reserve_size = reserve;
+	if (0 < reserve)
+		oom_reserve = GC_malloc_atomic_uncollectable(reserve);
+	oom_reserve_spent = false;
+}
 
-	size_t curr_usage = getMemUsage();
+/* ============================================================== */
+/* UTF-8 validation and scrubbing, ahead of conversion to scheme. */
+
+// True for control characters that have no business being in scheme
+// source: everything below 0x20 except whitespace, and DEL.
+static inline bool is_stray_control(unsigned char c)
+{
+	return (c < 0x20 and c != '\t' and c != '\n' and c != '\r'
+	        and c != '\f') or c == 0x7f;
+}
+
+#if defined(SCHEME_X86_DISPATCH)
+/// AVX2 part of clean_ascii_prefix(), below. It is compiled for AVX2
+/// whatever the build flags, and is called only if the CPU has it.
+__attribute__((target("avx2")))
+static size_t clean_ascii_prefix_avx2(const unsigned char* s, size_t len)
+{
+	size_t i = 0;
+	const __m256i sp = _mm256_set1_epi8(0x20);
+	const __m256i del = _mm256_set1_epi8(0x7f);
+	const __m256i tab = _mm256_set1_epi8('\t');
+	const __m256i nl = _mm256_set1_epi8('\n');
+	const __m256i cr = _mm256_set1_epi8('\r');
+	const __m256i ff = _mm256_set1_epi8('\f');
+	for (; i + 32 <= len; i += 32)
+	{
+		__m256i b = _mm256_loadu_si256((const __m256i*) (s + i));
+		if (_mm256_movemask_epi8(b)) break;
+		__m256i ws = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(b, tab),
+			                _mm256_cmpeq_epi8(b, nl)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(b, cr),
+			                _mm256_cmpeq_epi8(b, ff)));
+		__m256i bad = _mm256_or_si256(
+			_mm256_andnot_si256(ws, _mm256_cmpgt_epi8(sp, b)),
+			_mm256_cmpeq_epi8(b, del));
+		if (_mm256_movemask_epi8(bad)) break;
+	}
+	return i;
+}
+
+static bool cpu_has_avx2(void)
+{
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+#endif
+
+/// Return the length of the leading run of plain, printable ASCII
+/// (including whitespace) in the buffer. The scan is vectorized; it
+/// stops at the first block holding a non-ASCII byte or a stray
+/// control character, so the result is a multiple of the block size
+/// unless the end of the buffer was reached.
+static size_t clean_ascii_prefix(const unsigned char* s, size_t len)
+{
+	size_t i = 0;
+#if defined(SCHEME_X86_DISPATCH)
+	if (cpu_has_avx2())
+		i = clean_ascii_prefix_avx2(s, len);
+#endif
+#if defined(__SSE2__)
+	const __m128i sp16 = _mm_set1_epi8(0x20);
+	const __m128i del16 = _mm_set1_epi8(0x7f);
+	const __m128i tab16 = _mm_set1_epi8('\t');
+	const __m128i nl16 = _mm_set1_epi8('\n');
+	const __m128i cr16 = _mm_set1_epi8('\r');
+	const __m128i ff16 = _mm_set1_epi8('\f');
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i b = _mm_loadu_si128((const __m128i*) (s + i));
+		if (_mm_movemask_epi8(b)) break;
+		__m128i ws = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(b, tab16), _mm_cmpeq_epi8(b, nl16)),
+			_mm_or_si128(_mm_cmpeq_epi8(b, cr16), _mm_cmpeq_epi8(b, ff16)));
+		__m128i bad = _mm_or_si128(
+			_mm_andnot_si128(ws, _mm_cmplt_epi8(b, sp16)),
+			_mm_cmpeq_epi8(b, del16));
+		if (_mm_movemask_epi8(bad)) break;
+	}
+#endif
+	// Scalar fallback, and the tail end of the vector loops. This
+	// checks eight bytes at a time; words holding any control
+	// character (usually just a newline) get a closer look.
+	const uint64_t ones = 0x0101010101010101ULL;
+	const uint64_t highs = 0x8080808080808080ULL;
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64_t w;
+		memcpy(&w, s + i, 8);
+		if (w & highs) break;
+		uint64_t del = w ^ (0x7f * ones);
+		if (((w - 0x20 * ones) | (del - ones)) & ~w & highs)
+		{
+			bool bad = false;
+			for (size_t j = 0; j < 8; j++)
+				bad = bad or is_stray_control(s[i+j]);
+			if (bad) break;
+		}
+	}
+	return i;
+}
+
+/// Validate a UTF-8 buffer. Returns the byte offset of the first
+/// malformed sequence, or `len` if the whole buffer is well-formed.
+/// Overlong encodings, surrogates and code points above U+10FFFF are
+/// all rejected. The number of stray control characters seen is
+/// returned in `nctrl`.
+static size_t utf8_validate(const char* buf, size_t len, size_t& nctrl)
+{
+	const unsigned char* s = (const unsigned char*) buf;
+	nctrl = 0;
+	size_t i = 0;
+	while (i < len)
+	{
+		i += clean_ascii_prefix(s + i, len - i);
+		if (len <= i) break;
+
+		unsigned char c = s[i];
+		if (c < 0x80)
+		{
+			if (is_stray_control(c)) nctrl++;
+			i++;
+			continue;
+		}
+
+		size_t n;
+		unsigned char lo = 0x80, hi = 0xbf;
+		if (0xc2 <= c and c <= 0xdf) n = 1;
+		else if (0xe0 <= c and c <= 0xef)
+		{
+			n = 2;
+			if (0xe0 == c) lo = 0xa0;       // overlong
+			else if (0xed == c) hi = 0x9f;  // surrogates
+		}
+		else if (0xf0 <= c and c <= 0xf4)
+		{
+			n = 3;
+			if (0xf0 == c) lo = 0x90;       // overlong
+			else if (0xf4 == c) hi = 0x8f;  // above U+10FFFF
+		}
+		else return i;
+
+		if (len - i <= n) return i;
+		if (s[i+1] < lo or hi < s[i+1]) return i;
+		for (size_t j = 2; j <= n; j++)
+			if (s[i+j] < 0x80 or 0xbf < s[i+j]) return i;
+		i += n + 1;
+	}
+	return len;
+}
+
+/// Convert a UTF-8 string to a scheme string. Well-formed input goes
+/// straight to the length-aware constructor, with no catch frame, and
+/// byte for byte, unless `scrub` is set: then stray control characters
+/// (telnet junk from the cogserver shell) are dropped first. Only
+/// shell input should be scrubbed; anything else is data, and is
+/// passed through verbatim. Malformed input is not converted; instead,
+/// SCM_BOOL_F is returned, and `errmsg` says where it broke.
+/// This must be called in guile mode.
+SCM SchemeEval::utf8_to_scm(std::string_view str, std::string& errmsg,
+                            bool scrub)
+{
+	size_t nctrl;
+	size_t bad = utf8_validate(str.data(), str.size(), nctrl);
+	if (bad < str.size())
+	{
+		char msg[120];
+		snprintf(msg, sizeof(msg),
+			"Invalid UTF-8 in input at byte offset %zu (byte 0x%02x)",
+			bad, (unsigned char) str[bad]);
+		errmsg = msg;
+		return SCM_BOOL_F;
+	}
+
+	if (0 == nctrl or not scrub)
+		return scm_from_utf8_stringn(str.data(), str.size());
+
+	std::string clean;
+	clean.reserve(str.size() - nctrl);
+	for (char c : str)
+		if (not is_stray_control(c)) clean.push_back(c);
+	return scm_from_utf8_stringn(clean.data(), clean.size());
+}
+
+/* ============================================================== */
+/**
+ * Evaluate a scheme expression.
+ *
+ * This evaluator is tailored for being invoked by a shell, in several
+ * different ways:
+ *
+ * 1) It buffers up incomplete, line-by-line input, until there's
+ *    been enough input received to evaluate without error.
+ * 2) It catches errors, and prints the catch in a reasonably nicely
+ *    formatted way.
+ * 3) It converts any returned scheme expressions to a string, for easy
+ *    printing.
+ * 4) It concatenates any data sent to the scheme output port (e.g.
+ *    printed output from the scheme (display) function) to the returned
+ *    string.
+ *
+ * An "unforgiving" evaluator, with none of these amenities, can be
+ * found in eval_v(), below.
+ */
+void SchemeEval::eval_expr(std::string_view expr)
+{
+	// If we are recursing, then we already are in the guile
+	// environment, and don't need to do any additional setup.
+	// Just go.
+	if (_in_eval) {
+		do_eval(expr);
+		return;
+	}
+
+	_pexpr = expr;
+	_in_shell = true;
+	_in_eval = true;
+	traced_with_guile("eval_expr", c_wrap_eval, this);
+	_in_eval = false;
+	_in_shell = false;
+}
+
+void* SchemeEval::c_wrap_poll(void* p)
+{
+	SchemeEval* self = (SchemeEval*) p;
+	self->_answer.clear();
+	self->do_poll_result(self->_answer);
+	return p;
+}
+
+std::string SchemeEval::poll_result()
+{
+	traced_with_guile("poll_result", c_wrap_poll, this);
+	_answer_off = _answer.size();
+	return _answer;
+}
+
+/// Same as poll_result(), except that the result is left in a buffer
+/// owned by this evaluator, which the caller merely borrows. The
+/// pointer is valid until the next call to any of the poll_result()
+/// variants. Language bindings can wrap it without copying it, e.g.
+/// with JNI NewDirectByteBuffer().
+const char* SchemeEval::poll_result_borrow(size_t& len)
+{
+	traced_with_guile("poll_result", c_wrap_poll, this);
+	_answer_off = _answer.size();
+	len = _answer.size();
+	return _answer.data();
+}
+
+/// Same as poll_result(), except that the raw UTF-8 bytes are copied
+/// into the caller-supplied buffer, e.g. a direct ByteBuffer. If the
+/// result does not fit, the rest of it is handed out by the next
+/// call(s), before polling for more. Multi-byte characters may be
+/// split across calls.
+///
+/// As with snprintf(), the return value is the length of the whole
+/// (remaining) result, and not the number of bytes written: if it is
+/// greater than `buflen`, then only `buflen` bytes were written, and
+/// the difference is still to come. A return of zero means that
+/// there was no result at all.
+size_t SchemeEval::poll_result(char* buf, size_t buflen)
+{
+	if (_answer.size() <= _answer_off)
+	{
+		traced_with_guile("poll_result", c_wrap_poll, this);
+		_answer_off = 0;
+	}
+
+	size_t remaining = _answer.size() - _answer_off;
+	size_t len = std::min(buflen, remaining);
+	memcpy(buf, _answer.data() + _answer_off, len);
+	_answer_off += len;
+	return remaining;
+}
+
+void* SchemeEval::c_wrap_eval(void* p)
+{
+	SchemeEval* self = (SchemeEval*) p;
+
+	// Normally, neither of these are ever null.
+	// But sometimes, a heavily loaded server can crash here.
+	// Trying to figure out why ...
+	OC_ASSERT(self, "c_wrap_eval got null pointer!");
+	OC_ASSERT(self->_pexpr.data(), "c_wrap_eval got null expression!");
+
+	self->do_eval(self->_pexpr);
+	return self;
+}
+
+/// Arguments for a batch of shell-style evaluations.
+struct EvalBatch
+{
+	SchemeEval* self;
+	const std::vector<std::string>* exprs;
+	std::string* results;
+	std::vector<size_t>* offsets;
+};
+
+/**
+ * Evaluate a batch of expressions with a single entry into guile.
+ *
+ * Each expression is handled exactly as if begin_eval(), eval_expr()
+ * and poll_result() had been called on it in turn: output, printed
+ * value and error reports are all included, and incomplete input is
+ * carried over to the next expression. This is meant for language
+ * bindings (e.g. JNI) where each crossing into native code is costly.
+ *
+ * All of the results are appended, as UTF-8, to `results`. The
+ * `offsets` vector gets one more entry than there are expressions;
+ * the result of the i'th expression is the byte range from
+ * offsets[i] to offsets[i+1].
+ *
+ * This may not be called while this evaluator is itself evaluating
+ * (e.g. from scheme code that it is running): the batch would clobber
+ * the input buffer, result and error state of the eval in progress.
+ */
+void SchemeEval::eval_many(const std::vector<std::string>& exprs,
+                           std::string& results,
+                           std::vector<size_t>& offsets)
+{
+	if (_in_eval)
+		throw RuntimeException(TRACE_INFO,
+			"eval_many() cannot be nested inside another evaluation");
+
+	EvalBatch batch = {this, &exprs, &results, &offsets};
+	offsets.clear();
+	offsets.reserve(exprs.size() + 1);
+	offsets.push_back(results.size());
+
+	_in_shell = true;
+	_in_eval = true;
+	traced_with_guile("eval_many", c_wrap_eval_many, &batch);
+	_in_eval = false;
+	_in_shell = false;
+}
+
+void* SchemeEval::c_wrap_eval_many(void* p)
+{
+	EvalBatch* batch = (EvalBatch*) p;
+	SchemeEval* self = batch->self;
+
+	for (const std::string& expr : *batch->exprs)
+	{
+		self->begin_eval();
+		self->do_eval(expr);
+		self->do_poll_result(*batch->results);
+		batch->offsets->push_back(batch->results->size());
+	}
+	return p;
+}
+
+/// Ad hoc hack to try to limit guile memory consumption, while still
+/// providing decent performance.  The problem addressed here is that
+/// guile can get piggy with the system RAM, happily gobbling up RAM
+/// instead of garbage-collecting it.  Users have noticed. See github
+/// issue #1116. This improves on the original pull request #1117.
+/// Clue: bug report #1419 suggests the problem is related to the
+/// do_async_output flag-- setting it to false avoids the blow-up.
+/// Is there an i/o-related leak or weird reserve bug?
+static void do_gc(void)
+{
+	static size_t prev_usage = 0;
+
+	size_t curr_usage = getMemUsage();
 	// Yes, this is 10MBytes. Which seems nutty. But it does the trick...
 	if (10 * 1024 * 1024 < curr_usage - prev_usage)
 	{
 		prev_usage = curr_usage;
+		SchemeTrace::Span span("do_gc");
 		scm_gc();
 	}
 
@@ -734,7 +1624,7 @@ static void do_gc(void)
  * This method *must* be called in guile mode, in order for garbage
  * collection, etc. to work correctly!
  */
-void SchemeEval::do_eval(const std::string &expr)
+void SchemeEval::do_eval(std::string_view expr)
 {
 	per_thread_init();
 
@@ -743,6 +1633,7 @@ void SchemeEval::do_eval(const std::string &expr)
 	AtomSpace* saved_as = nullptr;
 	if (_atomspace)
 	{
+		SchemeTrace::Span span("atomspace-switch");
 		saved_as = SchemeSmob::ss_get_env_as("do_eval");
 		if (saved_as != _atomspace)
 			SchemeSmob::ss_set_env_as(_atomspace);
@@ -752,32 +1643,48 @@ void SchemeEval::do_eval(const std::string &expr)
 
 	_input_line += expr;
 
+	SCM saved_module = SCM_BOOL_F;
+	if (scm_is_true(_module))
+		saved_module = scm_set_current_module(_module);
+
 	redirect_output();
 	_caught_error = false;
 	_pending_input = false;
 	_error_msg.clear();
+	_error_key.clear();
 	set_captured_stack(SCM_BOOL_F);
 
 	// When invoked from the cogserver shell, it can happen that
-	// telnet control characters sneak through. These will not be
-	// valid utf8 strings, and scm_from_utf8_string will throw.
-	// Avoid some bad behavior by catching and cleaning up.
-	SCM eval_str = scm_internal_catch(SCM_BOOL_T,
-	                      (scm_t_catch_body) scm_from_utf8_string,
-	                      (void *) _input_line.c_str(),
-	                      SchemeEval::catch_handler_wrapper, this);
-
-	if (not _caught_error)
+	// telnet control characters sneak through. These get scrubbed;
+	// anything that is still not valid utf8 is reported as an error,
+	// instead of letting scm_from_utf8_string throw.
+	std::string badmsg;
+	SCM eval_str = utf8_to_scm(_input_line, badmsg, true);
+	if (scm_is_false(eval_str))
+	{
+		_caught_error = true;
+		_error_key = "decoding-error";
+		badmsg += "\nABORT: decoding-error";
+		set_error_string(scm_from_utf8_stringn(badmsg.data(), badmsg.size()));
+	}
+	else
 	{
+		SchemeTrace::Span span("scm_c_catch", _input_line);
+		SchemePerf::Scope perf(this, _input_line);
+		oom_enter();
 		SCM rc = scm_c_catch (SCM_BOOL_T,
 	                      (scm_t_catch_body) scm_eval_string,
 	                      (void *) eval_str,
 	                      SchemeEval::catch_handler_wrapper, this,
 	                      SchemeEval::preunwind_handler_wrapper, this);
+		oom_leave();
 		save_rc(rc);
 	}
 	restore_output();
 
+	if (scm_is_true(saved_module))
+		scm_set_current_module(saved_module);
+
 	if (saved_as)
 		SchemeSmob::ss_set_env_as(saved_as);
 
@@ -803,9 +1710,20 @@ void SchemeEval::begin_eval()
 std::string SchemeEval::poll_port()
 {
 	std::string rv;
+	poll_port(rv);
+	return rv;
+}
+
+static void json_escape(std::string&, const char*, size_t);
 
+/// Same as above, but append whatever was read to `out`, escaped as
+/// the body of a JSON string, if asked. Returns the number of bytes
+/// read.
+size_t SchemeEval::poll_port(std::string& out, bool json)
+{
 	// drain_output() calls us, and not always in server mode.
-	if (not _in_server) return rv;
+	if (not _in_server) return 0;
+	SchemeTrace::Span span("poll_port");
 
 	// int pipe_size;
 	// ioctl(_pipeno, FIONREAD, &pipe_size);
@@ -813,14 +1731,16 @@ std::string SchemeEval::poll_port()
 
 #define BUFSZ 65000
 	char buff[BUFSZ];
+	size_t total = 0;
 	while (1)
 	{
-		int nr = read(_pipeno, buff, BUFSZ-1);
-		if (-1 == nr) return rv;
-		buff[nr] = 0x0;
-		rv += buff;
+		ssize_t nr = read(_pipeno, buff, BUFSZ);
+		if (nr <= 0) return total;
+		if (json) json_escape(out, buff, nr);
+		else out.append(buff, nr);
+		total += nr;
 	}
-	return rv;
+	return total;
 }
 
 /// Set the _rc member in an pseudo-atomic fashion.
@@ -855,9 +1775,18 @@ void SchemeEval::save_rc(SCM rc)
 /// some other thread to see if eval() is generating output, and, if
 /// it is, to print it to stdout.
 std::string SchemeEval::do_poll_result()
+{
+	std::string rv;
+	do_poll_result(rv);
+	return rv;
+}
+
+/// Same as above, but append the result to `out`, rather than
+/// returning it, so that the caller's buffer is written directly.
+void SchemeEval::do_poll_result(std::string& out)
 {
 	per_thread_init();
-	if (_poll_done) return "";
+	if (_poll_done) return;
 
 	if (not _eval_done)
 	{
@@ -875,8 +1804,11 @@ std::string SchemeEval::do_poll_result()
 		while (not _eval_done)
 		{
 			_wait_done.wait_for(lck, std::chrono::milliseconds(300));
-			std::string rv = poll_port();
-			if (0 < rv.size()) return rv;
+			if (_structured)
+			{
+				if (structured_output(out)) return;
+			}
+			else if (0 < poll_port(out)) return;
 		}
 	}
 
@@ -890,6 +1822,14 @@ std::string SchemeEval::do_poll_result()
 	SCM tmp_rc = _rc;
 	save_rc(SCM_EOL);
 
+	if (_structured)
+	{
+		_poll_done = true;
+		structured_result(out, tmp_rc);
+		scm_remember_upto_here_1(tmp_rc);
+		return;
+	}
+
 	// If we are here, then evaluation is done. Check the various
 	// evaluation result flags, etc.
 	_poll_done = true;
@@ -899,7 +1839,7 @@ std::string SchemeEval::do_poll_result()
 	 * to true. */
 	if (_pending_input)
 	{
-		return "";
+		return;
 	}
 	_pending_input = false;
 	_input_line = "";
@@ -907,112 +1847,510 @@ std::string SchemeEval::do_poll_result()
 	if (_caught_error)
 	{
 		_error_string = poll_port();
-
-		char * str = scm_to_utf8_string(_scm_error_string);
-		_error_string += str;
-		free(str);
+		scm_append_utf8(_scm_error_string, _error_string);
 		set_error_string(SCM_EOL);
 		set_captured_stack(SCM_BOOL_F);
 
 		_error_string += "\n";
-		return _error_string;
+		out += _error_string;
+		return;
 	}
 
 	// First, we get the contents of the output port,
 	// and pass that on.
-	std::string rv = poll_port();
+	poll_port(out);
 
 	// Next, we append the "interpreter" output
-	rv += prt(tmp_rc);
-	rv += "\n";
+	out += prt(tmp_rc);
+	out += "\n";
 	scm_remember_upto_here_1(tmp_rc);
-	return rv;
 }
 
 /* ============================================================== */
+/* Structured results. */
 
-/**
- * do_scm_eval -- evaluate a scheme expression
- *
- * Similar to do_eval(), with several important differences:
- * 1) The argument must be an SCM expression.
- * 2) The expression is evaluated by "evo"
- * 3) No shell-friendly string and output management is performed.
- * 4) Evaluation errors are logged to the log file.
- *
- * This method *must* be called in guile mode, in order for garbage
- * collection, etc. to work correctly!
- */
-SCM SchemeEval::do_scm_eval(SCM sexpr, SCM (*evo)(void *))
+/// Append the string to the JSON document, as the body of a JSON
+/// string (without the quotes). Runs of characters that need no
+/// escaping are appended in one go.
+static void json_escape(std::string& out, const char* s, size_t len)
 {
-	per_thread_init();
-
-	// Set per-thread atomspace variable in the execution environment.
-	AtomSpace* saved_as = NULL;
-	if (_atomspace)
+	static const char hex[] = "0123456789abcdef";
+	size_t run = 0;
+	for (size_t i = 0; i < len; i++)
 	{
-		saved_as = SchemeSmob::ss_get_env_as("do_scm_eval");
-		if (saved_as != _atomspace)
-			SchemeSmob::ss_set_env_as(_atomspace);
-		else
-			saved_as = NULL;
+		unsigned char c = s[i];
+		if (0x20 <= c and '"' != c and '\\' != c) continue;
+
+		out.append(s + run, i - run);
+		run = i + 1;
+		switch (c)
+		{
+			case '"':  out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				out += "\\u00";
+				out += hex[c >> 4];
+				out += hex[c & 0xf];
+		}
 	}
+	out.append(s + run, len - run);
+}
 
-	// If we are running from the cogserver shell, capture all output
-	if (_in_shell)
-		redirect_output();
+static inline void json_field(std::string& out, const char* name,
+                              const char* s, size_t len)
+{
+	out += ",\"";
+	out += name;
+	out += "\":\"";
+	json_escape(out, s, len);
+	out += '"';
+}
 
-	_caught_error = false;
-	_error_msg.clear();
-	set_captured_stack(SCM_BOOL_F);
-	SCM rc = scm_c_catch (SCM_BOOL_T,
-	                 evo, (void *) sexpr,
-	                 SchemeEval::catch_handler_wrapper, this,
-	                 SchemeEval::preunwind_handler_wrapper, this);
+/// Select the result format of poll_result(). By default, it returns
+/// text, just as the shell prints it. In structured mode, each call
+/// returns one line of JSON, instead:
+///
+///   {"done":false,"output":"..."}
+///       Output printed so far by an expression that is still running.
+///   {"done":true,"output":"...","value":"..."}
+///       The remaining output, and the printed value (null if the
+///       value is unspecified).
+///   {"done":true,"output":"...","error":{"key":"...","report":"..."}}
+///       The remaining output, the key that was thrown, and the error
+///       report, including the backtrace.
+///   {"done":true,"pending":true}
+///       The expression is incomplete; send more of it.
+void SchemeEval::set_structured_results(bool on)
+{
+	_structured = on;
+}
 
-	// Restore the outport
-	if (_in_shell)
-		restore_output();
+/// Append a record of the output printed so far to `out`, if there is
+/// any. Returns true if there was.
+bool SchemeEval::structured_output(std::string& out)
+{
+	size_t mark = out.size();
+	out += "{\"done\":false,\"output\":\"";
+	if (0 == poll_port(out, true))
+	{
+		out.resize(mark);
+		return false;
+	}
+	out += "\"}\n";
+	return true;
+}
 
-	if (saved_as)
-		SchemeSmob::ss_set_env_as(saved_as);
+/// Append the final JSON record for an evaluation to `out`. Everything
+/// is escaped straight into `out`: the output as it is read from the
+/// pipe, and the value and error report from a buffer owned by this
+/// thread. Must be called in guile mode, with _poll_done already set.
+void SchemeEval::structured_result(std::string& out, SCM rc)
+{
+	if (_pending_input)
+	{
+		out += "{\"done\":true,\"pending\":true}\n";
+		return;
+	}
+	_input_line = "";
+
+	out += "{\"done\":true,\"output\":\"";
+	poll_port(out, true);
+	out += '"';
 
 	if (_caught_error)
 	{
-		char * str = scm_to_utf8_string(_scm_error_string);
-		// Don't blank out the error string yet.... we need it later.
-		// (probably because someone called cog-bind with an
-		// ExecutionOutputLink in it with a bad scheme schema node.)
-		// set_error_string(SCM_EOL);
+		std::string_view report = scm_to_utf8_view(_scm_error_string);
+		out += ",\"error\":{\"key\":\"";
+		json_escape(out, _error_key.data(), _error_key.size());
+		out += '"';
+		json_field(out, "report", report.data(), report.size());
+		out += "}}\n";
+		set_error_string(SCM_EOL);
 		set_captured_stack(SCM_BOOL_F);
-
-		// ?? Why are we discarding the output??
-		drain_output();
-
-		// Stick the guile stack trace into a string. Anyone who called
-		// us is responsible for checking for an error, and handling
-		// it as needed.
-		_error_msg = str;
-		_error_msg += "\n";
-
-		free(str);
-		return SCM_EOL;
+		return;
 	}
 
-	// Get the contents of the output port, and log it
-	if (_in_server and logger().is_info_enabled())
+	if (scm_is_eq(rc, SCM_UNSPECIFIED))
+		out += ",\"value\":null";
+	else if (SCM_SMOB_PREDICATE(SchemeSmob::cog_misc_tag, rc))
 	{
-		std::string str(poll_port());
-		if (0 < str.size())
-		{
-			logger().info("%s: Output: %s\n"
-			              "Was generated by expr: %s\n",
-			              __FUNCTION__, str.c_str(), prt(sexpr).c_str());
-		}
+		std::string val = SchemeSmob::misc_to_string(rc);
+		json_field(out, "value", val.data(), val.size());
 	}
-
-	// If we are in the cogserver, but are not in a shell context,
-	// then truncate the output, because it will never ever be displayed.
+	else
+	{
+		// As prt(), but without the copy into a std::string.
+		SCM port = scm_open_output_string();
+		scm_display(rc, port);
+		std::string_view val = scm_to_utf8_view(scm_get_output_string(port));
+		scm_close_port(port);
+		json_field(out, "value", val.data(), val.size());
+	}
+	out += "}\n";
+}
+
+/* ============================================================== */
+/* Pipelined evaluation. */
+
+// How many expressions may be submitted, and their results not yet
+// collected, before submit_expr() blocks.
+#ifndef PIPELINE_DEPTH
+#define PIPELINE_DEPTH 64
+#endif
+
+struct SchemeEval::EvalPipeline
+{
+	std::thread thread;
+	std::mutex mtx;
+	std::condition_variable work_cv;
+	std::condition_variable space_cv;
+	std::condition_variable done_cv;
+	std::deque<std::string> pending;
+	std::deque<std::string> results;
+	size_t depth;
+	size_t inflight;
+	bool stop;
+};
+
+void SchemeEval::start_pipeline(size_t depth)
+{
+	_pipeline = new EvalPipeline;
+	_pipeline->depth = depth;
+	_pipeline->inflight = 0;
+	_pipeline->stop = false;
+	_pipeline->thread = std::thread(&SchemeEval::pipeline_loop, this);
+}
+
+void SchemeEval::stop_pipeline(void)
+{
+	if (nullptr == _pipeline) return;
+	{
+		std::lock_guard<std::mutex> lck(_pipeline->mtx);
+		_pipeline->stop = true;
+	}
+	_pipeline->work_cv.notify_all();
+	_pipeline->thread.join();
+	delete _pipeline;
+	_pipeline = nullptr;
+}
+
+void SchemeEval::pipeline_loop(void)
+{
+	set_thread_name("atoms:pipeline");
+	scm_with_guile(c_wrap_pipeline, this);
+}
+
+/// Evaluate queued expressions, one after another, exactly as the
+/// shell would: begin_eval(), eval_expr(), poll_result().
+void * SchemeEval::c_wrap_pipeline(void * p)
+{
+	SchemeEval* self = (SchemeEval*) p;
+	EvalPipeline* pl = self->_pipeline;
+
+	std::unique_lock<std::mutex> lck(pl->mtx);
+	while (true)
+	{
+		while (pl->pending.empty() and not pl->stop)
+			pl->work_cv.wait(lck);
+		if (pl->stop) break;
+
+		std::string expr(std::move(pl->pending.front()));
+		pl->pending.pop_front();
+		lck.unlock();
+
+		self->_in_shell = true;
+		self->_in_eval = true;
+		self->begin_eval();
+		self->do_eval(expr);
+		std::string rv(self->do_poll_result());
+		self->_in_eval = false;
+		self->_in_shell = false;
+
+		lck.lock();
+		pl->results.push_back(std::move(rv));
+		pl->done_cv.notify_all();
+	}
+	return p;
+}
+
+/// Set the most expressions that may be in flight at once, that is,
+/// submitted with submit_expr() and not yet collected with
+/// next_result(). The default is PIPELINE_DEPTH.
+void SchemeEval::set_pipeline_depth(size_t depth)
+{
+	if (0 == depth) depth = 1;
+	if (nullptr == _pipeline)
+	{
+		start_pipeline(depth);
+		return;
+	}
+	std::lock_guard<std::mutex> lck(_pipeline->mtx);
+	_pipeline->depth = depth;
+	_pipeline->space_cv.notify_all();
+}
+
+/**
+ * Queue an expression for evaluation, without waiting for the results
+ * of the ones queued before it. The expressions are evaluated in
+ * order, on a thread belonging to this evaluator; collect the results
+ * with next_result(). This blocks only when the pipeline is full.
+ *
+ * Each result is what poll_result() would have returned, in full:
+ * the output, then the printed value or the error report. As in the
+ * shell, an incomplete expression gives an empty result, and is
+ * carried over to the next one.
+ *
+ * While any expressions are in flight, the evaluator must not be used
+ * in any other way.
+ */
+void SchemeEval::submit_expr(const std::string& expr)
+{
+	if (nullptr == _pipeline)
+		start_pipeline(PIPELINE_DEPTH);
+
+	EvalPipeline* pl = _pipeline;
+	std::unique_lock<std::mutex> lck(pl->mtx);
+	while (pl->depth <= pl->inflight)
+		pl->space_cv.wait(lck);
+
+	pl->pending.push_back(expr);
+	pl->inflight++;
+	pl->work_cv.notify_one();
+}
+
+/// Get the result of the oldest expression submitted with
+/// submit_expr() whose result has not been collected yet. If it is
+/// not done, wait for it, unless `wait` is false. Returns false if
+/// nothing is in flight, or if not waiting and the result isn't ready.
+bool SchemeEval::next_result(std::string& result, bool wait)
+{
+	if (nullptr == _pipeline) return false;
+
+	EvalPipeline* pl = _pipeline;
+	std::unique_lock<std::mutex> lck(pl->mtx);
+	if (0 == pl->inflight) return false;
+	if (pl->results.empty() and not wait) return false;
+	while (pl->results.empty())
+		pl->done_cv.wait(lck);
+
+	result = std::move(pl->results.front());
+	pl->results.pop_front();
+	pl->inflight--;
+	pl->space_cv.notify_one();
+	return true;
+}
+
+/* ============================================================== */
+/* Asynchronous, sampled logging of eval output. */
+
+// Log only one out of every `sample` evals that produced output, and
+// no more than `max_per_sec` lines per second; the rest are counted,
+// and the count is reported with the next line that does get logged.
+// Set from COG_EVAL_LOG_SAMPLE and COG_EVAL_LOG_RATE, or with
+// set_output_logging().
+static unsigned log_sample = 1;
+static unsigned log_max_per_sec = 100;
+#define LOG_QUEUE_MAX 1000
+
+struct PendingLog
+{
+	std::string output;
+	SCM expr;
+	size_t dropped;
+};
+
+static std::mutex log_mtx;
+static std::condition_variable log_cv;
+static std::deque<PendingLog> log_queue;
+static bool log_thread_started = false;
+static size_t log_seen = 0;
+static size_t log_dropped = 0;
+static std::chrono::steady_clock::time_point log_window;
+static unsigned log_in_window = 0;
+
+/// Configure the sampling and rate limiting of eval output logging.
+void SchemeEval::set_output_logging(unsigned sample, unsigned max_per_sec)
+{
+	std::lock_guard<std::mutex> lck(log_mtx);
+	log_sample = (0 < sample) ? sample : 1;
+	log_max_per_sec = max_per_sec;
+}
+
+// The formatter runs in guile mode, because prt() does.
+static void* c_wrap_log_formatter(void*)
+{
+	std::unique_lock<std::mutex> lck(log_mtx);
+	while (true)
+	{
+		while (log_queue.empty()) log_cv.wait(lck);
+		PendingLog pl(std::move(log_queue.front()));
+		log_queue.pop_front();
+		lck.unlock();
+
+		std::string expr(SchemeEval::prt(pl.expr));
+		scm_gc_unprotect_object(pl.expr);
+		if (0 < pl.dropped)
+			logger().info("do_scm_eval: Output: %s\n"
+			              "Was generated by expr: %s\n"
+			              "(%zu similar log lines were dropped)\n",
+			              pl.output.c_str(), expr.c_str(), pl.dropped);
+		else
+			logger().info("do_scm_eval: Output: %s\n"
+			              "Was generated by expr: %s\n",
+			              pl.output.c_str(), expr.c_str());
+		lck.lock();
+	}
+	return nullptr;
+}
+
+static void log_formatter(void)
+{
+	set_thread_name("atoms:evallog");
+	scm_with_guile(c_wrap_log_formatter, nullptr);
+}
+
+/// Queue the output of an eval, and the expression that produced it,
+/// for logging by the background formatter. Must be called in guile
+/// mode.
+void SchemeEval::log_eval_output(std::string&& output, SCM sexpr)
+{
+	std::lock_guard<std::mutex> lck(log_mtx);
+	if (0 != log_seen++ % log_sample)
+	{
+		log_dropped++;
+		return;
+	}
+
+	auto now = std::chrono::steady_clock::now();
+	if (std::chrono::seconds(1) <= now - log_window)
+	{
+		log_window = now;
+		log_in_window = 0;
+	}
+	if (log_max_per_sec <= log_in_window or
+	    LOG_QUEUE_MAX <= log_queue.size())
+	{
+		log_dropped++;
+		return;
+	}
+	log_in_window++;
+
+	if (not log_thread_started)
+	{
+		log_thread_started = true;
+		std::thread(log_formatter).detach();
+	}
+
+	log_queue.push_back({std::move(output),
+		scm_gc_protect_object(sexpr), log_dropped});
+	log_dropped = 0;
+	log_cv.notify_one();
+}
+
+/* ============================================================== */
+
+/**
+ * do_scm_eval -- evaluate a scheme expression
+ *
+ * Similar to do_eval(), with several important differences:
+ * 1) The argument must be an SCM expression.
+ * 2) The expression is evaluated by "evo"
+ * 3) No shell-friendly string and output management is performed.
+ * 4) Evaluation errors are logged to the log file.
+ *
+ * If `source` is given, output logging names it, rather than `sexpr`,
+ * as the expression that produced the output; pass the source text
+ * (or the name of the procedure) when `sexpr` is something that would
+ * not mean anything in the log, like a compiled thunk.
+ *
+ * This method *must* be called in guile mode, in order for garbage
+ * collection, etc. to work correctly!
+ */
+SCM SchemeEval::do_scm_eval(SCM sexpr, SCM (*evo)(void *), SCM source)
+{
+	per_thread_init();
+
+	// Set per-thread atomspace variable in the execution environment.
+	AtomSpace* saved_as = NULL;
+	if (_atomspace)
+	{
+		SchemeTrace::Span span("atomspace-switch");
+		saved_as = SchemeSmob::ss_get_env_as("do_scm_eval");
+		if (saved_as != _atomspace)
+			SchemeSmob::ss_set_env_as(_atomspace);
+		else
+			saved_as = NULL;
+	}
+
+	SCM saved_module = SCM_BOOL_F;
+	if (scm_is_true(_module))
+		saved_module = scm_set_current_module(_module);
+
+	// If we are running from the cogserver shell, capture all output
+	if (_in_shell)
+		redirect_output();
+
+	_caught_error = false;
+	_error_msg.clear();
+	_error_key.clear();
+	set_captured_stack(SCM_BOOL_F);
+	SCM rc;
+	{
+		SchemeTrace::Span span("scm_c_catch");
+		oom_enter();
+		rc = scm_c_catch (SCM_BOOL_T,
+		                 evo, (void *) sexpr,
+		                 SchemeEval::catch_handler_wrapper, this,
+		                 SchemeEval::preunwind_handler_wrapper, this);
+		oom_leave();
+	}
+
+	// Restore the outport
+	if (_in_shell)
+		restore_output();
+
+	if (scm_is_true(saved_module))
+		scm_set_current_module(saved_module);
+
+	if (saved_as)
+		SchemeSmob::ss_set_env_as(saved_as);
+
+	if (_caught_error)
+	{
+		// Don't blank out the error string yet.... we need it later.
+		// (probably because someone called cog-bind with an
+		// ExecutionOutputLink in it with a bad scheme schema node.)
+		// set_error_string(SCM_EOL);
+		set_captured_stack(SCM_BOOL_F);
+
+		// ?? Why are we discarding the output??
+		drain_output();
+
+		// Stick the guile stack trace into a string. Anyone who called
+		// us is responsible for checking for an error, and handling
+		// it as needed.
+		_error_msg.clear();
+		scm_append_utf8(_scm_error_string, _error_msg);
+		_error_msg += "\n";
+		return SCM_EOL;
+	}
+
+	// Get the contents of the output port, and log it. The formatting
+	// of the expression is done in the background, and only for a
+	// sample of the evals; see log_eval_output().
+	if (_in_server and logger().is_info_enabled())
+	{
+		std::string str(poll_port());
+		if (0 < str.size())
+			log_eval_output(std::move(str),
+				SCM_UNBNDP(source) ? sexpr : source);
+	}
+
+	// If we are in the cogserver, but are not in a shell context,
+	// then truncate the output, because it will never ever be displayed.
 	// (i.e. don't overflow the output buffers.) If we are in_shell,
 	// then we are here probably because user typed something that
 	// caused some ExecutionOutputLink to call some scheme snippet.
@@ -1023,63 +2361,905 @@ SCM SchemeEval::do_scm_eval(SCM sexpr, SCM (*evo)(void *))
 	return rc;
 }
 
-/* ============================================================== */
+/* ============================================================== */
+/* Interrupt delivery watchdog. */
+
+// Guile acts on an interrupt only at its next safe point. A thread
+// that is off in C++ code (e.g. in the AtomSpace, or blocked in some
+// system call) may not get there for a long time. So, if an interrupt
+// has not been acted on after a short while, the watchdog escalates:
+// it signals the evaluating thread, so that blocking system calls
+// return with EINTR, and it logs that the evaluator is stuck in a long
+// C++ region. This is repeated until the interrupt is taken.
+
+#ifndef EVAL_WAKEUP_SIGNAL
+#define EVAL_WAKEUP_SIGNAL SIGURG
+#endif
+
+// Milliseconds to wait before each escalation.
+#define INTERRUPT_ESCALATE_MS 20
+
+struct PendingInterrupt
+{
+	std::chrono::steady_clock::time_point sent;
+	pthread_t thread;
+	unsigned escalations;
+	const SCM* eval_thread;   // The evaluator's _eval_thread.
+};
+
+// Guards intr_pending, and every evaluator's _eval_thread, so that an
+// interrupt is never recorded for an evaluation that has finished.
+static std::mutex intr_mtx;
+static std::condition_variable intr_cv;
+static std::map<SchemeEval*, PendingInterrupt> intr_pending;
+static bool intr_watchdog_started = false;
+
+// Time from interrupt() to the unwind in catch_handler().
+static size_t intr_delivered = 0;
+static size_t intr_escalations = 0;
+static double intr_total_ms = 0.0;
+static double intr_max_ms = 0.0;
+
+static void wakeup_handler(int) {}
+
+static void interrupt_watchdog(void)
+{
+	set_thread_name("atoms:intr-wdog");
+	std::unique_lock<std::mutex> lck(intr_mtx);
+	while (true)
+	{
+		if (intr_pending.empty())
+		{
+			intr_cv.wait(lck);
+			continue;
+		}
+		intr_cv.wait_for(lck,
+			std::chrono::milliseconds(INTERRUPT_ESCALATE_MS));
+
+		auto now = std::chrono::steady_clock::now();
+		for (auto it = intr_pending.begin(); it != intr_pending.end(); )
+		{
+			auto& pr = *it;
+			PendingInterrupt& pi = pr.second;
+
+			// The evaluation finished, without taking the interrupt;
+			// its thread may be idle, or gone. Leave it be.
+			if (SCM_EOL == *pi.eval_thread)
+			{
+				it = intr_pending.erase(it);
+				continue;
+			}
+			it++;
+
+			long waited = std::chrono::duration_cast<
+				std::chrono::milliseconds>(now - pi.sent).count();
+			if (waited < INTERRUPT_ESCALATE_MS * (pi.escalations + 1))
+				continue;
+
+			pi.escalations++;
+			intr_escalations++;
+			pthread_kill(pi.thread, EVAL_WAKEUP_SIGNAL);
+
+			if (1 == pi.escalations or 0 == pi.escalations % 50)
+				logger().warn("[SchemeEval] Interrupt not taken after %ld ms;"
+				              " evaluator %p is in a long C++ region",
+				              waited, pr.first);
+		}
+	}
+}
+
+/// Send an interrupt to the evaluator, if it is evaluating, record
+/// it, and make sure that the watchdog is watching. Must be called in
+/// guile mode. The check, the record and the async mark are all made
+/// under intr_mtx, so they cannot race with eval_thread_end().
+static void interrupt_sent(SchemeEval* ev, const SCM& eval_thread,
+                           const pthread_t& thr)
+{
+	std::lock_guard<std::mutex> lck(intr_mtx);
+	if (SCM_EOL == eval_thread) return;
+
+	if (not intr_watchdog_started)
+	{
+		intr_watchdog_started = true;
+
+		// Install a do-nothing handler, without SA_RESTART, so that
+		// the signal interrupts blocking system calls. Leave any
+		// handler that the application installed alone.
+		struct sigaction old;
+		sigaction(EVAL_WAKEUP_SIGNAL, nullptr, &old);
+		if (SIG_DFL == old.sa_handler or SIG_IGN == old.sa_handler)
+		{
+			struct sigaction sa;
+			memset(&sa, 0, sizeof(sa));
+			sa.sa_handler = wakeup_handler;
+			sigemptyset(&sa.sa_mask);
+			sigaction(EVAL_WAKEUP_SIGNAL, &sa, nullptr);
+		}
+		std::thread(interrupt_watchdog).detach();
+	}
+
+	// Repeated control-C's count from the first one.
+	if (intr_pending.end() == intr_pending.find(ev))
+		intr_pending[ev] = {std::chrono::steady_clock::now(), thr, 0,
+		                    &eval_thread};
+	scm_system_async_mark_for_thread(throw_thunk, eval_thread);
+	intr_cv.notify_one();
+}
+
+/// The evaluator is about to start evaluating, on this thread.
+static void eval_thread_begin(SCM& eval_thread, pthread_t& thr)
+{
+	SCM self = scm_current_thread();
+	std::lock_guard<std::mutex> lck(intr_mtx);
+	eval_thread = self;
+	thr = pthread_self();
+}
+
+/// The evaluator is done evaluating. Any interrupt that is still
+/// pending arrived too late to do anything; forget it.
+static void eval_thread_end(SchemeEval* ev, SCM& eval_thread)
+{
+	std::lock_guard<std::mutex> lck(intr_mtx);
+	eval_thread = SCM_EOL;
+	intr_pending.erase(ev);
+}
+
+/// Stop watching the evaluator. If `taken` is true, the interrupt was
+/// acted on, and the delivery latency is recorded.
+static void interrupt_done(SchemeEval* ev, bool taken)
+{
+	std::lock_guard<std::mutex> lck(intr_mtx);
+	auto it = intr_pending.find(ev);
+	if (intr_pending.end() == it) return;
+
+	if (taken)
+	{
+		double ms = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - it->second.sent).count();
+		intr_delivered++;
+		intr_total_ms += ms;
+		if (intr_max_ms < ms) intr_max_ms = ms;
+		logger().info("[SchemeEval] Interrupt taken after %.3f ms "
+		              "(%u escalations)", ms, it->second.escalations);
+	}
+	intr_pending.erase(it);
+}
+
+/// Summary of interrupt delivery latency, for monitoring.
+std::string SchemeEval::interrupt_stats(void)
+{
+	std::lock_guard<std::mutex> lck(intr_mtx);
+	char buf[200];
+	snprintf(buf, sizeof(buf),
+		"interrupts: %zu delivered, mean %.3f ms, max %.3f ms, "
+		"%zu escalations, %zu pending",
+		intr_delivered,
+		(0 < intr_delivered) ? intr_total_ms / intr_delivered : 0.0,
+		intr_max_ms, intr_escalations, intr_pending.size());
+	return buf;
+}
+
+/* ============================================================== */
+
+/**
+ * interrupt() - convert user's control-C at keyboard into exception.
+ *
+ * Calling this will interrupt whatever guile processing this evaluator
+ * is doing -- it calls the guile routine `cog-throw-user-interrupt`
+ * which calls the `SchemeEval::throw_except()` method.  The resulting
+ * exception should halt whatever might be running in the _eval_thread
+ * associated with this evaluator.  If that thread is slow to notice,
+ * the interrupt watchdog (above) escalates.
+ */
+void SchemeEval::interrupt(void)
+{
+	scm_with_guile(c_wrap_interrupt, this);
+}
+
+void * SchemeEval::c_wrap_interrupt(void* p)
+{
+	SchemeEval *self = (SchemeEval *) p;
+	interrupt_sent(self, self->_eval_thread, self->_eval_pthread);
+	return self;
+}
+
+/* ============================================================== */
+
+SCM recast_scm_eval_string(void * expr)
+{
+	return scm_eval_string((SCM)expr);
+}
+
+/* ============================================================== */
+/* Persistent, on-disk cache of compiled expressions. */
+
+// Directory holding the compiled-expression cache; empty if the cache
+// is disabled. Set from COG_EVAL_CACHE_DIR, or set_eval_cache().
+static std::string eval_cache_dir;
+
+// Expressions are compiled only once they have been seen this many
+// times; one-off expressions are not worth the compile.
+static unsigned eval_cache_hot = 2;
+
+// At most this many expressions are tracked, compiled or not; the
+// least recently evaluated are dropped first.
+#define EVAL_CACHE_MAX_ENTRIES 4096
+
+// Compiled code has the macros that were in scope expanded into it,
+// and its top-level references are bound to whatever was visible in
+// the module when it first ran. Both go stale when guile-user is
+// changed, and so this is bumped by every define (define-syntax
+// included) and every module-use! in guile-user, by way of a module
+// observer. Thunks compiled in an older generation are recompiled.
+static std::atomic<uint64_t> define_generation(0);
+static SCM guile_user_module = SCM_BOOL_F;
+
+static SCM ss_module_modified(SCM module)
+{
+	define_generation++;
+	return SCM_UNSPECIFIED;
+}
+
+static void install_define_observer(void)
+{
+	guile_user_module = scm_c_resolve_module("guile-user");
+	SCM observer = scm_c_make_gsubr("cog-module-modified",
+		1, 0, 0, (scm_t_subr) ss_module_modified);
+	scm_call_2(scm_variable_ref(scm_c_lookup("module-observe")),
+		guile_user_module, observer);
+}
+
+struct CachedExpr
+{
+	std::string expr;
+	unsigned seen;
+	SCM thunk;        // GC-protected; SCM_BOOL_F until compiled.
+	uint64_t gen;     // define_generation that the thunk belongs to.
+	bool on_disk;     // A cache file existed when first seen.
+	std::list<uint64_t>::iterator lru;
+};
+
+static std::mutex eval_cache_mtx;
+static std::unordered_map<uint64_t, CachedExpr> eval_cache;
+static std::list<uint64_t> eval_cache_lru;  // Most recent first.
+
+// The macro context of the last define_generation, see below.
+static std::string eval_cache_context;
+static uint64_t eval_cache_context_gen = UINT64_MAX;
+
+// Cache file layout: the bytecode, as compiled, then the context and
+// the expression text, then a trailer with the magic and the three
+// lengths. The bytecode comes first so that guile can map the file
+// as is, with load-thunk-from-file; an ELF image does not care what
+// follows it. Both the context and the text are compared when the
+// file is loaded, so that neither a hash collision nor a change of
+// macros is trusted.
+static const char eval_cache_magic[8] = {'C','O','G','E','V','A','L','2'};
+
+struct CacheTrailer
+{
+	uint64_t codelen;
+	uint64_t ctxlen;
+	uint64_t exprlen;
+	char magic[8];
+};
+
+// 64-bit FNV-1a
+static uint64_t expr_hash(std::string_view expr)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for (unsigned char c : expr)
+		hash = (hash ^ c) * 1099511628211ULL;
+	return hash;
+}
+
+static std::string eval_cache_path(const std::string& dir, uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.go", (unsigned long long) key);
+	return dir + name;
+}
+
+// Must hold eval_cache_mtx.
+static void eval_cache_drop(std::unordered_map<uint64_t, CachedExpr>::iterator it)
+{
+	if (scm_is_true(it->second.thunk))
+		scm_gc_unprotect_object(it->second.thunk);
+	eval_cache_lru.erase(it->second.lru);
+	eval_cache.erase(it);
+}
+
+enum { CACHE_INTERPRET, CACHE_RUN, CACHE_COMPILE };
+
+/// Look up the expression, and decide how to run it: interpreted,
+/// from an already-compiled thunk, or compiled (or loaded) first.
+/// `thunk` is set to the last thunk compiled, if any, even if stale.
+/// Nothing is touched on disk, apart from one stat() the first time
+/// that an expression is seen.
+static int eval_cache_lookup(std::string_view expr, uint64_t key, SCM& thunk)
+{
+	uint64_t gen = define_generation.load();
+
+	std::lock_guard<std::mutex> lck(eval_cache_mtx);
+	if (eval_cache_dir.empty()) return CACHE_INTERPRET;
+
+	auto it = eval_cache.find(key);
+
+	// On a hash collision, the newcomer takes over the slot.
+	if (eval_cache.end() != it and it->second.expr != expr)
+	{
+		eval_cache_drop(it);
+		it = eval_cache.end();
+	}
+
+	if (eval_cache.end() == it)
+	{
+		if (EVAL_CACHE_MAX_ENTRIES <= eval_cache.size())
+			eval_cache_drop(eval_cache.find(eval_cache_lru.back()));
+
+		struct stat sb;
+		eval_cache_lru.push_front(key);
+		it = eval_cache.emplace(key, CachedExpr{std::string(expr), 0,
+			SCM_BOOL_F, 0,
+			0 == stat(eval_cache_path(eval_cache_dir, key).c_str(), &sb),
+			eval_cache_lru.begin()}).first;
+	}
+	else
+		eval_cache_lru.splice(eval_cache_lru.begin(), eval_cache_lru,
+		                      it->second.lru);
+
+	CachedExpr& ce = it->second;
+	thunk = ce.thunk;
+	if (scm_is_true(ce.thunk) and gen == ce.gen) return CACHE_RUN;
+	if (ce.seen < eval_cache_hot) ce.seen++;
+	if (eval_cache_hot <= ce.seen or ce.on_disk) return CACHE_COMPILE;
+	return CACHE_INTERPRET;
+}
+
+// Record the names of the macros bound in the module.
+static SCM add_macro_name(void* names, SCM sym, SCM var, SCM acc)
+{
+	if (SCM_VARIABLEP(var) and scm_is_true(scm_variable_bound_p(var)) and
+	    scm_is_true(scm_macro_p(scm_variable_ref(var))))
+	{
+		std::string name;
+		scm_append_utf8(scm_symbol_to_string(sym), name);
+		((std::vector<std::string>*) names)->push_back(std::move(name));
+	}
+	return acc;
+}
+
+/// What the expansion of an expression in guile-user depends on,
+/// other than its text: the names of the macros defined there, and
+/// the modules that it uses. This goes into each cache file, so that
+/// a file written under different macros is not loaded. A macro that
+/// keeps its name, but changes its body from one run to the next,
+/// is not noticed; clear the cache directory when that happens.
+static std::string macro_context(void)
+{
+	uint64_t gen = define_generation.load();
+	{
+		std::lock_guard<std::mutex> lck(eval_cache_mtx);
+		if (gen == eval_cache_context_gen) return eval_cache_context;
+	}
+
+	std::vector<std::string> names;
+	scm_internal_hash_fold(add_macro_name, &names, SCM_EOL,
+		SCM_MODULE_OBARRAY(guile_user_module));
+	std::sort(names.begin(), names.end());
+
+	std::string ctx = "guile-user\n";
+	for (const std::string& name : names)
+		ctx += name + " ";
+	ctx += "\n";
+
+	SCM module_name = scm_variable_ref(scm_c_lookup("module-name"));
+	SCM uses = scm_call_1(scm_variable_ref(scm_c_lookup("module-uses")),
+		guile_user_module);
+	for (; scm_is_pair(uses); uses = SCM_CDR(uses))
+	{
+		scm_append_utf8(scm_object_to_string(
+			scm_call_1(module_name, SCM_CAR(uses)), SCM_UNDEFINED), ctx);
+		ctx += " ";
+	}
+
+	std::lock_guard<std::mutex> lck(eval_cache_mtx);
+	eval_cache_context = ctx;
+	eval_cache_context_gen = gen;
+	return ctx;
+}
+
+static SCM compile_proc = SCM_BOOL_F;
+static SCM load_thunk_proc = SCM_BOOL_F;
+static SCM load_thunk_file_proc = SCM_BOOL_F;
+
+// Load the compiled thunk from the cache file, if the file is for
+// this very expression and context; else return SCM_BOOL_F. The file
+// is mapped, not read: the trailer and the text are compared in
+// place, and guile then maps the bytecode itself, read-only, so that
+// its pages are shared with every other process that loads it. Guile
+// is handed the already-open file, by way of /proc/self/fd, so that
+// it loads exactly the file that was checked, even if the cache entry
+// is replaced in the meantime.
+static SCM load_cache_file(const std::string& path, std::string_view ctx,
+                           std::string_view expr)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return SCM_BOOL_F;
+
+	bool match = false;
+	struct stat sb;
+	if (0 == fstat(fd, &sb) and sizeof(CacheTrailer) <= (size_t) sb.st_size)
+	{
+		size_t len = sb.st_size;
+		void* map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED != map)
+		{
+			const char* base = (const char*) map;
+			CacheTrailer tr;
+			memcpy(&tr, base + len - sizeof(tr), sizeof(tr));
+			match =
+				0 == memcmp(tr.magic, eval_cache_magic, sizeof(tr.magic)) and
+				tr.ctxlen == ctx.size() and tr.exprlen == expr.size() and
+				0 < tr.codelen and
+				tr.codelen + tr.ctxlen + tr.exprlen + sizeof(tr) == len and
+				0 == memcmp(base + tr.codelen, ctx.data(), ctx.size()) and
+				0 == memcmp(base + tr.codelen + ctx.size(),
+				            expr.data(), expr.size());
+			munmap(map, len);
+		}
+	}
+
+	SCM thunk = SCM_BOOL_F;
+	if (match)
+	{
+		char fdpath[32];
+		snprintf(fdpath, sizeof(fdpath), "/proc/self/fd/%d", fd);
+		thunk = scm_call_1(load_thunk_file_proc,
+		                   scm_from_utf8_string(fdpath));
+	}
+	close(fd);
+	return thunk;
+}
+
+// Write the cache file: to a fresh temporary file first, which is
+// then renamed into place, so that readers never see part of a file.
+static void write_cache_file(const std::string& dir, const std::string& path,
+                             std::string_view ctx, std::string_view expr,
+                             SCM bv)
+{
+	std::string tmp = dir + "/.tmp-XXXXXX";
+	int fd = mkstemp(&tmp[0]);
+	if (fd < 0)
+	{
+		logger().warn("[SchemeEval] Can't write to the eval cache %s: %s",
+		              dir.c_str(), strerror(errno));
+		return;
+	}
+
+	CacheTrailer tr;
+	tr.codelen = SCM_BYTEVECTOR_LENGTH(bv);
+	tr.ctxlen = ctx.size();
+	tr.exprlen = expr.size();
+	memcpy(tr.magic, eval_cache_magic, sizeof(tr.magic));
+
+	FILE* fp = fdopen(fd, "wb");
+	bool ok = fp and
+		1 == fwrite(SCM_BYTEVECTOR_CONTENTS(bv), tr.codelen, 1, fp) and
+		ctx.size() == fwrite(ctx.data(), 1, ctx.size(), fp) and
+		expr.size() == fwrite(expr.data(), 1, expr.size(), fp) and
+		1 == fwrite(&tr, sizeof(tr), 1, fp);
+	scm_remember_upto_here_1(bv);
+	if (fp) ok = (0 == fclose(fp)) and ok;
+	else close(fd);
+
+	if (not ok or 0 != rename(tmp.c_str(), path.c_str()))
+		unlink(tmp.c_str());
+}
+
+// Called, in the catch, with (expr-str key try-disk). Load the
+// compiled expression from its cache file if allowed, else compile it
+// and write the file; remember the thunk, and run it.
+static SCM eval_compiled(void* p)
+{
+	SCM args = (SCM) p;
+	SCM expr_str = SCM_CAR(args);
+	uint64_t key = scm_to_uint64(SCM_CADR(args));
+	bool try_disk = scm_is_true(SCM_CADDR(args));
+	uint64_t gen = define_generation.load();
+
+	if (scm_is_false(compile_proc))
+	{
+		compile_proc = scm_gc_protect_object(scm_c_eval_string(
+			"(lambda (expr-str)"
+			"  ((@ (system base compile) compile)"
+			"    (with-input-from-string"
+			"      (string-append \"(begin \" expr-str \"\n)\") read)"
+			"    #:to 'bytecode #:env (current-module)))"));
+		load_thunk_proc = scm_variable_ref(
+			scm_c_public_lookup("system vm loader", "load-thunk-from-memory"));
+		load_thunk_file_proc = scm_variable_ref(
+			scm_c_public_lookup("system vm loader", "load-thunk-from-file"));
+	}
+
+	std::string dir;
+	{
+		std::lock_guard<std::mutex> lck(eval_cache_mtx);
+		dir = eval_cache_dir;
+	}
+	std::string expr;
+	scm_append_utf8(expr_str, expr);
+	std::string ctx = macro_context();
+	std::string path = eval_cache_path(dir, key);
+
+	SCM thunk = SCM_BOOL_F;
+	if (try_disk and not dir.empty())
+		thunk = load_cache_file(path, ctx, expr);
+	if (scm_is_false(thunk))
+	{
+		SCM bv = scm_call_1(compile_proc, expr_str);
+		if (not dir.empty())
+			write_cache_file(dir, path, ctx, expr, bv);
+		thunk = scm_call_1(load_thunk_proc, bv);
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(eval_cache_mtx);
+		auto it = eval_cache.find(key);
+		if (eval_cache.end() != it and it->second.expr == expr)
+		{
+			if (scm_is_true(it->second.thunk))
+				scm_gc_unprotect_object(it->second.thunk);
+			it->second.thunk = scm_gc_protect_object(thunk);
+			it->second.gen = gen;
+		}
+	}
+	return scm_call_0(thunk);
+}
+
+static SCM eval_thunk(void* thunk)
+{
+	return scm_call_0((SCM) thunk);
+}
+
+/**
+ * Enable (or, with an empty string, disable) the on-disk cache of
+ * compiled expressions used by eval_v() and friends. Expressions that
+ * have been evaluated `hot` times are compiled to bytecode and saved
+ * under `dir`, keyed by a hash of their text and by the guile version.
+ * The compiled thunk is kept in memory, and reused until guile-user
+ * is changed by a define. After a restart, cached expressions are
+ * loaded from disk the first time that they are seen, skipping the
+ * compile. Only evaluations in guile-user are cached.
+ */
+void SchemeEval::set_eval_cache(const std::string& dir, unsigned hot)
+{
+	std::lock_guard<std::mutex> lck(eval_cache_mtx);
+	eval_cache_hot = (0 < hot) ? hot : 1;
+	while (not eval_cache.empty())
+		eval_cache_drop(eval_cache.begin());
+	eval_cache_dir.clear();
+	if (dir.empty()) return;
+
+	char vers[32];
+	snprintf(vers, sizeof(vers), "/guile-%d.%d.%d", SCM_MAJOR_VERSION,
+		SCM_MINOR_VERSION, SCM_MICRO_VERSION);
+	mkdir(dir.c_str(), 0755);
+	std::string vdir = dir + vers;
+	mkdir(vdir.c_str(), 0755);
+	eval_cache_dir = vdir;
+}
+
+/// Evaluate the expression string, through the compile cache if it
+/// is enabled, and the expression is hot or already cached.
+SCM SchemeEval::do_string_eval(std::string_view expr, SCM expr_str)
+{
+	SchemePerf::Scope perf(this, expr);
+
+	// Compiled thunks are bound to the module they were compiled in,
+	// so evaluators with a private environment don't share them.
+	if (scm_is_true(_module) or
+	    not scm_is_eq(scm_current_module(), guile_user_module))
+		return do_scm_eval(expr_str, recast_scm_eval_string);
+
+	uint64_t key = expr_hash(expr);
+	SCM thunk = SCM_BOOL_F;
+	switch (eval_cache_lookup(expr, key, thunk))
+	{
+		case CACHE_RUN:
+			return do_scm_eval(thunk, eval_thunk, expr_str);
+		case CACHE_COMPILE:
+		{
+			// The file is only worth reading before the first compile;
+			// after that, it is stale, or was just written by us.
+			SCM args = scm_list_3(expr_str, scm_from_uint64(key),
+			                      scm_from_bool(scm_is_false(thunk)));
+			return do_scm_eval(args, eval_compiled, expr_str);
+		}
+		default:
+			return do_scm_eval(expr_str, recast_scm_eval_string);
+	}
+}
+
+void * SchemeEval::c_wrap_eval_v(void * p)
+{
+	SchemeEval *self = (SchemeEval *) p;
+	SCM expr_str = utf8_to_scm(self->_pexpr, self->_error_msg);
+	if (scm_is_false(expr_str))
+	{
+		self->_caught_error = true;
+		return self;
+	}
+	SCM rc = self->do_string_eval(self->_pexpr, expr_str);
+
+	// Pass evaluation errors out of the wrapper.
+	if (self->eval_error()) return self;
+
+	self->_retval = SchemeSmob::scm_to_protom(rc);
+	return self;
+}
+
+
+/* ============================================================== */
+/* Memoization of eval_v() results. */
+
+// A memoized result stays valid for as long as neither the atomspace
+// (nor any of its parents) nor the scheme world has changed.
+// Atomspace changes are counted by hooking up to the add/remove
+// signals of the atomspace and of each of its parents. Scheme-side
+// changes are counted by define_generation: every define,
+// define-syntax and module-use! in guile-user. Assignments with set!,
+// and changes made to Values, are not seen at all; call
+// invalidate_memo() after making any.
+
+#define MEMO_MAX_ENTRIES 4096
+
+// The change counter of one atomspace, and the signal connections
+// that bump it: one pair per atomspace in the chain of parents. The
+// connections are dropped as soon as no memoized result, and no
+// evaluation whose result is yet to be memoized, depends on them.
+struct MemoSpace
+{
+	std::weak_ptr<Atom> alive;
+	std::shared_ptr<std::atomic<uint64_t>> generation;
+	std::vector<std::pair<std::weak_ptr<Atom>, std::pair<int, int>>> conns;
+	size_t nentries;
+	size_t npending;   // Lookups that missed, not yet stored.
+};
+
+typedef std::pair<AtomSpace*, std::string> MemoKey;
+
+// Lets memo_cache be searched with a string_view, without a copy.
+struct MemoLess
+{
+	typedef void is_transparent;
+	template<typename A, typename B>
+	bool operator()(const A& a, const B& b) const
+	{
+		if (a.first != b.first) return a.first < b.first;
+		return std::string_view(a.second) < std::string_view(b.second);
+	}
+};
+
+struct MemoEntry
+{
+	ValuePtr value;
+	uint64_t as_gen;
+	uint64_t scm_gen;
+	std::list<MemoKey>::iterator lru;
+};
+
+static std::mutex memo_mtx;
+static std::map<AtomSpace*, MemoSpace> memo_spaces;
+static std::map<MemoKey, MemoEntry, MemoLess> memo_cache;
+static std::list<MemoKey> memo_lru;  // Most recent first.
+static uint64_t memo_epoch = 0;      // Bumped by invalidate_memo().
+static size_t memo_hits = 0;
+static size_t memo_misses = 0;
+static size_t memo_invalidations = 0;
+
+static void memo_disconnect(MemoSpace& ms)
+{
+	for (auto& pr : ms.conns)
+	{
+		AtomPtr ap(pr.first.lock());
+		if (nullptr == ap) continue;
+		AtomSpace* as = (AtomSpace*) ap.get();
+		as->atomAddedSignal().disconnect(pr.second.first);
+		as->atomRemovedSignal().disconnect(pr.second.second);
+	}
+	ms.conns.clear();
+}
+
+// Stop watching the atomspace, if nothing depends on it any more.
+// Must be called with memo_mtx held.
+static void memo_release(std::map<AtomSpace*, MemoSpace>::iterator sit)
+{
+	if (0 < sit->second.nentries or 0 < sit->second.npending) return;
+	memo_disconnect(sit->second);
+	memo_spaces.erase(sit);
+}
+
+// Must be called with memo_mtx held.
+static void memo_erase(std::map<MemoKey, MemoEntry, MemoLess>::iterator it)
+{
+	auto sit = memo_spaces.find(it->first.first);
+	if (memo_spaces.end() != sit)
+	{
+		sit->second.nentries--;
+		memo_release(sit);
+	}
+	memo_lru.erase(it->second.lru);
+	memo_cache.erase(it);
+}
+
+static void memo_forget(AtomSpace* as)
+{
+	auto it = memo_cache.lower_bound(std::make_pair(as, std::string()));
+	while (memo_cache.end() != it and it->first.first == as)
+	{
+		memo_lru.erase(it->second.lru);
+		it = memo_cache.erase(it);
+	}
+}
+
+// The atomspace change counter, connected to the atomspace signals
+// if it is not yet. Must be called with memo_mtx held.
+static MemoSpace& memo_space(AtomSpace* as)
+{
+	auto it = memo_spaces.find(as);
+
+	// A different atomspace may have been created at the same address.
+	if (memo_spaces.end() != it and it->second.alive.expired())
+	{
+		memo_forget(as);
+		memo_disconnect(it->second);
+		memo_spaces.erase(it);
+		it = memo_spaces.end();
+	}
+
+	if (memo_spaces.end() == it)
+	{
+		auto gen = std::make_shared<std::atomic<uint64_t>>(0);
+		MemoSpace ms{as->Atom::get_handle(), gen, {}, 0, 0};
+		for (AtomSpace* sp = as; sp; sp = sp->get_environ())
+		{
+			int added = sp->atomAddedSignal().connect(
+				[gen](const auto&) { (*gen)++; });
+			int removed = sp->atomRemovedSignal().connect(
+				[gen](const auto&) { (*gen)++; });
+			ms.conns.emplace_back(sp->Atom::get_handle(),
+				std::make_pair(added, removed));
+		}
+		it = memo_spaces.emplace(as, std::move(ms)).first;
+	}
+	return it->second;
+}
+
+/// Look up a memoized result. If there is none, return false, along
+/// with the generations to store with the result once it is computed.
+/// The atomspace is then watched until memo_store() or memo_abandon()
+/// is called, so that changes made meanwhile are seen.
+static bool memo_lookup(AtomSpace* as, std::string_view expr,
+                        ValuePtr& vp, uint64_t& as_gen, uint64_t& scm_gen)
+{
+	std::lock_guard<std::mutex> lck(memo_mtx);
+	scm_gen = define_generation.load() + memo_epoch;
+	MemoSpace& ms = memo_space(as);
+	as_gen = ms.generation->load();
+
+	auto it = memo_cache.find(std::make_pair(as, expr));
+	if (memo_cache.end() != it and
+	    it->second.as_gen == as_gen and it->second.scm_gen == scm_gen)
+	{
+		memo_hits++;
+		memo_lru.splice(memo_lru.begin(), memo_lru, it->second.lru);
+		vp = it->second.value;
+		return true;
+	}
+
+	ms.npending++;
+	if (memo_cache.end() != it)
+	{
+		memo_invalidations++;
+		memo_erase(it);
+	}
+	memo_misses++;
+	return false;
+}
 
-/**
- * interrupt() - convert user's control-C at keyboard into exception.
- *
- * Calling this will interrupt whatever guile processing this evaluator
- * is doing -- it calls the guile routine `cog-throw-user-interrupt`
- * which calls the `SchemeEval::throw_except()` method.  The resulting
- * exception should halt whatever might be running in the _eval_thread
- * associated with this evaluator.
- */
-void SchemeEval::interrupt(void)
+/// The evaluation after a missed lookup failed; there is nothing to
+/// store.
+static void memo_abandon(AtomSpace* as)
 {
-	if (SCM_EOL == _eval_thread) return;
-	scm_with_guile(c_wrap_interrupt, this);
+	std::lock_guard<std::mutex> lck(memo_mtx);
+	auto sit = memo_spaces.find(as);
+	if (memo_spaces.end() == sit) return;
+	if (0 < sit->second.npending) sit->second.npending--;
+	memo_release(sit);
 }
 
-void * SchemeEval::c_wrap_interrupt(void* p)
+static void memo_store(AtomSpace* as, std::string_view expr,
+                       const ValuePtr& vp, uint64_t as_gen, uint64_t scm_gen)
 {
-	SchemeEval *self = (SchemeEval *) p;
-	SCM thr = self->_eval_thread;
-	if (SCM_EOL == thr) return self;
+	std::lock_guard<std::mutex> lck(memo_mtx);
+
+	// The atomspace changed while the result was being computed (or
+	// it was replaced by another at the same address); if so, the
+	// result can't be kept.
+	auto sit = memo_spaces.find(as);
+	if (memo_spaces.end() == sit) return;
+	if (0 < sit->second.npending) sit->second.npending--;
+	if (sit->second.generation->load() != as_gen)
+	{
+		memo_release(sit);
+		return;
+	}
 
-	scm_system_async_mark_for_thread(throw_thunk, thr);
+	MemoKey key(as, std::string(expr));
+	auto it = memo_cache.find(key);
+	if (memo_cache.end() != it)
+	{
+		it->second.value = vp;
+		it->second.as_gen = as_gen;
+		it->second.scm_gen = scm_gen;
+		memo_lru.splice(memo_lru.begin(), memo_lru, it->second.lru);
+		return;
+	}
 
-	return self;
-}
+	sit->second.nentries++;
+	if (MEMO_MAX_ENTRIES <= memo_cache.size())
+		memo_erase(memo_cache.find(memo_lru.back()));
 
-/* ============================================================== */
+	memo_lru.push_front(key);
+	memo_cache.emplace(key, MemoEntry{vp, as_gen, scm_gen, memo_lru.begin()});
+}
 
-SCM recast_scm_eval_string(void * expr)
+/**
+ * Enable or disable memoization of eval_v() results for this
+ * evaluator. When enabled, the caller promises that the expressions
+ * passed to eval_v() are pure queries: their results depend only on
+ * the contents of the evaluator's atomspace, and they change nothing.
+ * Repeated queries are then answered without entering guile at all,
+ * until the atomspace (or scheme state) changes.
+ */
+void SchemeEval::set_memoize(bool on)
 {
-	return scm_eval_string((SCM)expr);
+	_memoize = on;
 }
 
-void * SchemeEval::c_wrap_eval_v(void * p)
+/// Drop all memoized results, in all evaluators.
+void SchemeEval::invalidate_memo(void)
 {
-	SchemeEval *self = (SchemeEval *) p;
-	// scm_from_utf8_string is lots faster than scm_from_locale_string
-	SCM expr_str = scm_from_utf8_string(self->_pexpr->c_str());
-	SCM rc = self->do_scm_eval(expr_str, recast_scm_eval_string);
-
-	// Pass evaluation errors out of the wrapper.
-	if (self->eval_error()) return self;
-
-	self->_retval = SchemeSmob::scm_to_protom(rc);
-	return self;
+	std::lock_guard<std::mutex> lck(memo_mtx);
+	memo_epoch++;
+	while (not memo_cache.empty())
+		memo_erase(memo_cache.begin());
 }
 
+/// Summary of memoization effectiveness, for monitoring.
+std::string SchemeEval::memo_stats(void)
+{
+	std::lock_guard<std::mutex> lck(memo_mtx);
+	size_t lookups = memo_hits + memo_misses;
+	char buf[200];
+	snprintf(buf, sizeof(buf),
+		"memo: %zu hits, %zu misses (%.1f%% hit rate), "
+		"%zu invalidations, %zu entries, %zu atomspaces watched",
+		memo_hits, memo_misses,
+		(0 < lookups) ? 100.0 * memo_hits / lookups : 0.0,
+		memo_invalidations, memo_cache.size(), memo_spaces.size());
+	return buf;
+}
 
 /**
  * Evaluate a string containing a scheme expression, returning a
  * ProtoAtom (Handle, TruthValue or Value).  If an evaluation error
  * occurs, an exception is thrown, and the stack trace is logged to
- * the log file.
+ * the log file. The expression is taken as a string_view, and is not
+ * copied on the way in; a std::string or a C string works as well.
  */
-ValuePtr SchemeEval::eval_v(const std::string &expr)
+ValuePtr SchemeEval::eval_v(std::string_view expr)
 {
 	// If we are recursing, then we already are in the guile
 	// environment, and don't need to do any additional setup.
@@ -1089,8 +3269,10 @@ ValuePtr SchemeEval::eval_v(const std::string &expr)
 	// guile, again, in this very same thread.  Another possibility
 	// is that some scheme code called cog-execute! explicitly.
 	if (_in_eval) {
-		// scm_from_utf8_string is lots faster than scm_from_locale_string
-		SCM expr_str = scm_from_utf8_string(expr.c_str());
+		std::string badmsg;
+		SCM expr_str = utf8_to_scm(expr, badmsg);
+		if (scm_is_false(expr_str))
+			throw RuntimeException(TRACE_INFO, "%s", badmsg.c_str());
 		// An alternative here would be to evaluate the string directly,
 		// so that any exceptions thrown get passed right on up the stack.
 		// I think this is the right thing to do; but I'm a bit confused.
@@ -1098,25 +3280,36 @@ ValuePtr SchemeEval::eval_v(const std::string &expr)
 		// SCM rc = scm_eval_string(expr_str);
 		// However, I suspect that might actually result in the exception
 		// being hidden away.  So lets be conservative, and throw.
-		SCM rc = do_scm_eval(expr_str, recast_scm_eval_string);
+		SCM rc = do_string_eval(expr, expr_str);
 		if (eval_error())
 			throw RuntimeException(TRACE_INFO, "%s", _error_msg.c_str());
 		return SchemeSmob::scm_to_protom(rc);
 	}
 
-	_pexpr = &expr;
+	// Memoized results are returned without entering guile.
+	ValuePtr rv;
+	uint64_t as_gen = 0, scm_gen = 0;
+	bool memo = _memoize and _atomspace and scm_is_false(_module);
+	if (memo and memo_lookup(_atomspace, expr, rv, as_gen, scm_gen))
+		return rv;
+
+	_pexpr = expr;
 	_in_eval = true;
-	scm_with_guile(c_wrap_eval_v, this);
+	traced_with_guile("eval_v", c_wrap_eval_v, this);
 	_in_eval = false;
 
 	// Convert evaluation errors into C++ exceptions.
 	if (eval_error())
+	{
+		if (memo) memo_abandon(_atomspace);
 		throw RuntimeException(TRACE_INFO, "%s", _error_msg.c_str());
+	}
 
 	// We do not want this->_retval to point at anything after we return.
 	// This is so that we do not hold a long-term reference to the TV.
-	ValuePtr rv;
 	swap(rv, _retval);
+	if (memo)
+		memo_store(_atomspace, expr, rv, as_gen, scm_gen);
 	return rv;
 }
 
@@ -1126,24 +3319,26 @@ ValuePtr SchemeEval::eval_v(const std::string &expr)
  * If an evaluation error occurs, an exception is thrown, and the stack
  * trace is logged to the log file.
  */
-AtomSpace* SchemeEval::eval_as(const std::string &expr)
+AtomSpace* SchemeEval::eval_as(std::string_view expr)
 {
 	// If we are recursing, then we already are in the guile
 	// environment, and don't need to do any additional setup.
 	// Just go.
 	if (_in_eval) {
-		// scm_from_utf8_string is lots faster than scm_from_locale_string
-		SCM expr_str = scm_from_utf8_string(expr.c_str());
-		SCM rc = do_scm_eval(expr_str, recast_scm_eval_string);
+		std::string badmsg;
+		SCM expr_str = utf8_to_scm(expr, badmsg);
+		if (scm_is_false(expr_str))
+			throw RuntimeException(TRACE_INFO, "%s", badmsg.c_str());
+		SCM rc = do_string_eval(expr, expr_str);
 
 		// Pass evaluation errors out of the wrapper.
 		if (eval_error()) return nullptr;
 		return SchemeSmob::ss_to_atomspace(rc);
 	}
 
-	_pexpr = &expr;
+	_pexpr = expr;
 	_in_eval = true;
-	scm_with_guile(c_wrap_eval_as, this);
+	traced_with_guile("eval_as", c_wrap_eval_as, this);
 	_in_eval = false;
 
 	// Convert evaluation errors into C++ exceptions.
@@ -1156,9 +3351,13 @@ AtomSpace* SchemeEval::eval_as(const std::string &expr)
 void * SchemeEval::c_wrap_eval_as(void * p)
 {
 	SchemeEval *self = (SchemeEval *) p;
-	// scm_from_utf8_string is lots faster than scm_from_locale_string
-	SCM expr_str = scm_from_utf8_string(self->_pexpr->c_str());
-	SCM rc = self->do_scm_eval(expr_str, recast_scm_eval_string);
+	SCM expr_str = utf8_to_scm(self->_pexpr, self->_error_msg);
+	if (scm_is_false(expr_str))
+	{
+		self->_caught_error = true;
+		return self;
+	}
+	SCM rc = self->do_string_eval(self->_pexpr, expr_str);
 
 	// Pass evaluation errors out of the wrapper.
 	if (self->eval_error()) return self;
@@ -1167,6 +3366,140 @@ void * SchemeEval::c_wrap_eval_as(void * p)
 	return self;
 }
 
+/**
+ * Evaluate a string containing a scheme expression, returning a
+ * stream over its result. Use this instead of eval_v() when the
+ * result is a very long list, or a generator: the elements are
+ * converted to C++ a chunk at a time, as the stream is iterated,
+ * and the consumer can stop early. See SchemeStream for details.
+ * If an evaluation error occurs, an exception is thrown.
+ */
+SchemeStreamPtr SchemeEval::eval_stream(std::string_view expr,
+                                        size_t chunk_size)
+{
+	SchemeStreamPtr strm;
+	if (_in_eval) {
+		std::string badmsg;
+		SCM expr_str = utf8_to_scm(expr, badmsg);
+		if (scm_is_false(expr_str))
+			throw RuntimeException(TRACE_INFO, "%s", badmsg.c_str());
+		SCM rc = do_string_eval(expr, expr_str);
+		if (eval_error())
+			throw RuntimeException(TRACE_INFO, "%s", _error_msg.c_str());
+		strm = std::make_shared<SchemeStream>(this, rc);
+	}
+	else
+	{
+		_pexpr = expr;
+		_in_eval = true;
+		scm_with_guile(c_wrap_eval_stream, this);
+		_in_eval = false;
+
+		if (eval_error())
+			throw RuntimeException(TRACE_INFO, "%s", _error_msg.c_str());
+
+		swap(strm, _retstream);
+	}
+	strm->set_chunk_size(chunk_size);
+	return strm;
+}
+
+void * SchemeEval::c_wrap_eval_stream(void * p)
+{
+	SchemeEval *self = (SchemeEval *) p;
+	SCM expr_str = utf8_to_scm(self->_pexpr, self->_error_msg);
+	if (scm_is_false(expr_str))
+	{
+		self->_caught_error = true;
+		return self;
+	}
+	SCM rc = self->do_string_eval(self->_pexpr, expr_str);
+
+	// Pass evaluation errors out of the wrapper.
+	if (self->eval_error()) return self;
+
+	self->_retstream = std::make_shared<SchemeStream>(self, rc);
+	return self;
+}
+
+// Read the one expression in the string, and compile it (instead of
+// handing it to the interpreter, as scm_eval_string does). Anything
+// after the first expression is an error, not silently dropped.
+static SCM compile_string(void* expr_str)
+{
+	static SCM compiler = scm_gc_protect_object(scm_c_eval_string(
+		"(lambda (str)"
+		"  (with-input-from-string str"
+		"    (lambda ()"
+		"      (let* ((form (read)) (more (read)))"
+		"        (if (eof-object? form)"
+		"          (error \"Prepared expression is empty\"))"
+		"        (if (not (eof-object? more))"
+		"          (error \"Prepared expression must be a single form:\" str))"
+		"        ((@ (system base compile) compile) form"
+		"          #:env (current-module))))))"));
+	return scm_call_1(compiler, (SCM) expr_str);
+}
+
+/**
+ * Compile a scheme expression that evaluates to a procedure, such as
+ * "(lambda (x y) ...)", and return it as a prepared procedure. This
+ * can then be called repeatedly, with arguments bound directly from
+ * C++, without any per-call string building, reading or compiling.
+ * See SchemePrepared for details. If the string holds anything other
+ * than exactly one expression, or it fails to compile, or it is not a
+ * procedure, an exception is thrown.
+ */
+SchemePreparedPtr SchemeEval::prepare(std::string_view expr)
+{
+	if (_in_eval) {
+		std::string_view saved_pexpr = _pexpr;
+		_pexpr = expr;
+		c_wrap_prepare(this);
+		_pexpr = saved_pexpr;
+	}
+	else
+	{
+		_pexpr = expr;
+		_in_eval = true;
+		scm_with_guile(c_wrap_prepare, this);
+		_in_eval = false;
+	}
+
+	if (eval_error())
+		throw RuntimeException(TRACE_INFO, "%s", _error_msg.c_str());
+
+	SchemePreparedPtr rv;
+	swap(rv, _retprep);
+	return rv;
+}
+
+void * SchemeEval::c_wrap_prepare(void * p)
+{
+	SchemeEval *self = (SchemeEval *) p;
+	SCM expr_str = utf8_to_scm(self->_pexpr, self->_error_msg);
+	if (scm_is_false(expr_str))
+	{
+		self->_caught_error = true;
+		return self;
+	}
+	SCM rc = self->do_scm_eval(expr_str, compile_string);
+
+	// Pass evaluation errors out of the wrapper.
+	if (self->eval_error()) return self;
+
+	if (scm_is_false(scm_procedure_p(rc)))
+	{
+		self->_caught_error = true;
+		self->_error_msg = "Prepared expression is not a procedure: ";
+		self->_error_msg += self->_pexpr;
+		return self;
+	}
+
+	self->_retprep = std::make_shared<SchemePrepared>(self, rc, expr_str);
+	return self;
+}
+
 /* ============================================================== */
 /* ============================================================== */
 
@@ -1175,35 +3508,41 @@ static SCM thunk_scm_eval(void * expr)
 	return scm_eval((SCM)expr, scm_interaction_environment());
 }
 
+/// Unpack the arguments for a function call. If varargs is a
+/// ListLink, its elements are the arguments; otherwise varargs itself
+/// is the single argument.
+static SCM handle_args_to_scm(const Handle& varargs)
+{
+	SCM args = SCM_EOL;
+	if (nullptr == varargs) return args;
+
+	HandleSeq single_arg{varargs};
+	const HandleSeq &oset = varargs->get_type() == LIST_LINK ?
+		varargs->getOutgoingSet() : single_arg;
+
+	// Iterate in reverse, because cons chains in reverse.
+	size_t sz = oset.size();
+	for (size_t i=sz; i>0; i--)
+	{
+		SCM sh = SchemeSmob::handle_to_scm(oset[i-1]);
+		args = scm_cons(sh, args);
+	}
+	return args;
+}
+
 /**
  * do_apply_scm -- apply named function func to arguments in ListLink
  * It is assumed that varargs is a ListLink, containing a list of
  * atom handles. This list is unpacked, and then the function func
  * is applied to them. The SCM value returned by the function is returned.
  */
-SCM SchemeEval::do_apply_scm(const std::string& func, const Handle& varargs )
+SCM SchemeEval::do_apply_scm(std::string_view func, const Handle& varargs )
 {
-	SCM sfunc = scm_from_utf8_symbol(func.c_str());
-	SCM expr = SCM_EOL;
+	SchemePerf::Scope perf(this, func);
+	SCM sfunc = scm_from_utf8_symboln(func.data(), func.size());
 
 	// If there were args, pass the args to the function.
-	if (varargs)
-	{
-		// If varargs is a ListLink, its elements are passed to the
-		// function, otherwise the single argument is passed.
-		HandleSeq single_arg{varargs};
-		const HandleSeq &oset = varargs->get_type() == LIST_LINK ?
-			varargs->getOutgoingSet() : single_arg;
-
-		// Iterate in reverse, because cons chains in reverse.
-		size_t sz = oset.size();
-		for (size_t i=sz; i>0; i--)
-		{
-			SCM sh = SchemeSmob::handle_to_scm(oset[i-1]);
-			expr = scm_cons(sh, expr);
-		}
-	}
-	expr = scm_cons(sfunc, expr);
+	SCM expr = scm_cons(sfunc, handle_args_to_scm(varargs));
 
 	// TODO: it would be nice to pass exceptions on through, but
 	// this currently breaks unit tests.
@@ -1241,10 +3580,10 @@ ValuePtr SchemeEval::apply_v(const std::string &func, Handle varargs)
 		return SchemeSmob::scm_to_protom(smob);
 	}
 
-	_pexpr = &func;
+	_pexpr = func;
 	_hargs = varargs;
 	_in_eval = true;
-	scm_with_guile(c_wrap_apply_v, this);
+	traced_with_guile("apply_v", c_wrap_apply_v, this);
 	_in_eval = false;
 	_hargs = nullptr;
 
@@ -1264,12 +3603,330 @@ ValuePtr SchemeEval::apply_v(const std::string &func, Handle varargs)
 void * SchemeEval::c_wrap_apply_v(void * p)
 {
 	SchemeEval *self = (SchemeEval *) p;
-	SCM smob = self->do_apply_scm(*self->_pexpr, self->_hargs);
+	SCM smob = self->do_apply_scm(self->_pexpr, self->_hargs);
 	if (self->eval_error()) return self;
 	self->_retval = SchemeSmob::scm_to_protom(smob);
 	return self;
 }
 
+/* ============================================================== */
+/* Numeric bridge between FloatValues and bytevectors. */
+
+/**
+ * Copy the contents of a FloatValue into a new f64 bytevector, in a
+ * single memcpy, without boxing the individual doubles.
+ *
+ * The storage of the FloatValue itself is not lent out: bytevectors
+ * are writable from scheme, while Values are immutable, shared and
+ * hashed, and so must never be changed in place.
+ *
+ * This must be called in guile mode.
+ */
+SCM SchemeEval::float_value_to_bytevector(const ValuePtr& vp)
+{
+	FloatValuePtr fvp(FloatValueCast(vp));
+	if (nullptr == fvp)
+		throw RuntimeException(TRACE_INFO,
+			"Expecting a FloatValue, got %s",
+			(nullptr == vp) ? "(nullptr)" : vp->to_string().c_str());
+
+	const std::vector<double>& dbl = fvp->value();
+	SCM bv = scm_make_f64vector(scm_from_size_t(dbl.size()), SCM_UNDEFINED);
+	if (0 < dbl.size())
+		memcpy(SCM_BYTEVECTOR_CONTENTS(bv), dbl.data(),
+		       dbl.size() * sizeof(double));
+	return bv;
+}
+
+/**
+ * Create a FloatValue from an f64 bytevector (or any bytevector
+ * whose length is a multiple of eight). The contents are copied in
+ * one go; no per-element unboxing is done.
+ *
+ * This must be called in guile mode.
+ */
+ValuePtr SchemeEval::bytevector_to_float_value(SCM bv)
+{
+	if (not scm_is_bytevector(bv))
+		scm_wrong_type_arg_msg("cog-f64vector->value", 1, bv,
+			"f64vector or bytevector");
+
+	size_t len = SCM_BYTEVECTOR_LENGTH(bv);
+	if (0 != len % sizeof(double))
+		scm_wrong_type_arg_msg("cog-f64vector->value", 1, bv,
+			"bytevector with length a multiple of 8");
+
+	const double* dbl = (const double*) SCM_BYTEVECTOR_CONTENTS(bv);
+	std::vector<double> fv(dbl, dbl + len / sizeof(double));
+	scm_remember_upto_here_1(bv);
+	return createFloatValue(std::move(fv));
+}
+
+// scm_wrong_type_arg_msg() longjmps, skipping C++ destructors; the
+// ValuePtr must be gone before it is called, or the Value leaks.
+static SCM ss_value_to_f64vector(SCM svalue)
+{
+	SCM rv = SCM_BOOL_F;
+	{
+		ValuePtr vp(SchemeSmob::scm_to_protom(svalue));
+		if (nullptr != FloatValueCast(vp))
+			rv = SchemeEval::float_value_to_bytevector(vp);
+	}
+	if (scm_is_false(rv))
+		scm_wrong_type_arg_msg("cog-value->f64vector", 1, svalue,
+			"FloatValue");
+	return rv;
+}
+
+static SCM ss_f64vector_to_value(SCM bv)
+{
+	return SchemeSmob::protom_to_scm(
+		SchemeEval::bytevector_to_float_value(bv));
+}
+
+/* ============================================================== */
+
+/// Arguments for apply_v_batch().
+struct ApplyBatch
+{
+	SchemeEval* self;
+	const std::string* func;
+	const HandleSeq* groundings;
+	bool vectorized;
+	std::vector<ValuePtr>* results;
+};
+
+// Look up the function, then apply it to each argument list in the
+// vector; or, if vectorized, just once, to the whole vector.
+static SCM apply_batch(void* p)
+{
+	SCM args = (SCM) p;
+	SCM proc = scm_eval(SCM_CAR(args), scm_interaction_environment());
+	SCM argv = SCM_CADR(args);
+	if (scm_is_true(SCM_CADDR(args)))
+		return scm_call_1(proc, argv);
+
+	size_t n = SCM_SIMPLE_VECTOR_LENGTH(argv);
+	SCM rv = scm_c_make_vector(n, SCM_BOOL_F);
+	for (size_t i = 0; i < n; i++)
+		SCM_SIMPLE_VECTOR_SET(rv, i,
+			scm_apply_0(proc, SCM_SIMPLE_VECTOR_REF(argv, i)));
+	return rv;
+}
+
+/**
+ * apply_v_batch -- apply the named function to each of many groundings,
+ * with a single entry into guile, a single catch frame, and a single
+ * atomspace switch. Each grounding is unpacked just as in apply_v().
+ * This is meant for the pattern matcher, which otherwise calls
+ * apply_v() once per candidate grounding of a GroundedPredicate.
+ *
+ * If `vectorized` is true, the function is called just once, with a
+ * vector holding the argument list of each grounding, and it must
+ * return a vector of the same length, holding the results (e.g. truth
+ * values) in the same order.
+ *
+ * The results are returned in order. If any call fails, or the
+ * vectorized function returns a malformed result, an exception is
+ * thrown.
+ */
+std::vector<ValuePtr> SchemeEval::apply_v_batch(const std::string& func,
+                                                const HandleSeq& groundings,
+                                                bool vectorized)
+{
+	std::vector<ValuePtr> results;
+	ApplyBatch batch = {this, &func, &groundings, vectorized, &results};
+
+	if (_in_eval) {
+		c_wrap_apply_v_batch(&batch);
+	}
+	else
+	{
+		_in_eval = true;
+		traced_with_guile("apply_v_batch", c_wrap_apply_v_batch, &batch);
+		_in_eval = false;
+	}
+
+	if (eval_error())
+		throw RuntimeException(TRACE_INFO,
+			"Unable to apply `%s` to a batch of %zu groundings\n%s",
+			func.c_str(), groundings.size(), _error_msg.c_str());
+
+	return results;
+}
+
+void * SchemeEval::c_wrap_apply_v_batch(void * p)
+{
+	ApplyBatch* batch = (ApplyBatch*) p;
+	SchemeEval* self = batch->self;
+	size_t n = batch->groundings->size();
+
+	SCM argv = scm_c_make_vector(n, SCM_EOL);
+	for (size_t i = 0; i < n; i++)
+		SCM_SIMPLE_VECTOR_SET(argv, i,
+			handle_args_to_scm((*batch->groundings)[i]));
+
+	SCM args = scm_list_3(scm_from_utf8_symbol(batch->func->c_str()),
+		argv, scm_from_bool(batch->vectorized));
+	SCM rv = self->do_scm_eval(args, apply_batch, SCM_CAR(args));
+	if (self->eval_error()) return p;
+
+	if (not scm_is_simple_vector(rv) or SCM_SIMPLE_VECTOR_LENGTH(rv) != n)
+	{
+		self->_caught_error = true;
+		self->_error_msg = "Vectorized function must return a vector "
+			"with one result per grounding\n";
+		return p;
+	}
+
+	batch->results->reserve(n);
+	for (size_t i = 0; i < n; i++)
+		batch->results->push_back(
+			SchemeSmob::scm_to_protom(SCM_SIMPLE_VECTOR_REF(rv, i)));
+	return p;
+}
+
+/* ============================================================== */
+/* Environment snapshots. */
+
+// Snapshot modules, by name. Each holds the bindings made by some
+// prelude, on top of everything that is visible in (guile-user).
+static std::mutex snapshot_mtx;
+static std::map<std::string, SCM> snapshots;
+
+// Return a new, empty module that sees all of the bindings of the
+// parent module by reference. A define in the child shadows the
+// parent's binding; the parent is never copied.
+static SCM make_child_module(SCM parent)
+{
+	SCM mod = scm_call_0(scm_variable_ref(scm_c_lookup("make-module")));
+	scm_call_2(scm_variable_ref(scm_c_lookup("module-use!")), mod, parent);
+	return mod;
+}
+
+struct SnapshotArgs
+{
+	SchemeEval* self;
+	const std::string* name;
+	const std::string* prelude;
+};
+
+void * SchemeEval::c_wrap_snapshot(void * p)
+{
+	SnapshotArgs* args = (SnapshotArgs*) p;
+	SchemeEval* self = args->self;
+
+	std::string badmsg;
+	SCM expr_str = utf8_to_scm(*args->prelude, badmsg);
+	if (scm_is_false(expr_str))
+	{
+		self->_caught_error = true;
+		self->_error_msg = badmsg;
+		return p;
+	}
+
+	SCM tmpl = make_child_module(scm_c_resolve_module("guile-user"));
+	SCM saved = self->_module;
+	if (scm_is_true(saved)) scm_gc_protect_object(saved);
+	self->set_module(tmpl);
+	self->do_scm_eval(expr_str, recast_scm_eval_string);
+	self->set_module(saved);
+	if (scm_is_true(saved)) scm_gc_unprotect_object(saved);
+	if (self->_caught_error) return p;
+
+	std::lock_guard<std::mutex> lck(snapshot_mtx);
+	auto it = snapshots.find(*args->name);
+	if (snapshots.end() != it)
+		scm_gc_unprotect_object(it->second);
+	snapshots[*args->name] = scm_gc_protect_object(tmpl);
+	return p;
+}
+
+/**
+ * Evaluate the prelude (helper defines, use-modules, loads) once, in
+ * a module of its own, and keep that module as a named snapshot. The
+ * prelude is evaluated by this evaluator, in its atomspace; this
+ * evaluator's own environment is left as it was. An existing snapshot
+ * of the same name is replaced; evaluators already using it are not
+ * affected. Throws if the prelude fails.
+ */
+void SchemeEval::snapshot_environment(const std::string& name,
+                                      const std::string& prelude)
+{
+	SnapshotArgs args{this, &name, &prelude};
+	if (_in_eval)
+		c_wrap_snapshot(&args);
+	else
+	{
+		_in_eval = true;
+		scm_with_guile(c_wrap_snapshot, &args);
+		_in_eval = false;
+	}
+
+	if (eval_error())
+		throw RuntimeException(TRACE_INFO, "%s", _error_msg.c_str());
+}
+
+struct UseArgs
+{
+	SchemeEval* self;
+	const std::string* name;
+	bool found;
+};
+
+// The lookup is done under the lock, so that the snapshot cannot be
+// replaced (and collected) before the child module holds on to it.
+void * SchemeEval::c_wrap_use_environment(void * p)
+{
+	UseArgs* args = (UseArgs*) p;
+	std::lock_guard<std::mutex> lck(snapshot_mtx);
+	auto it = snapshots.find(*args->name);
+	args->found = (snapshots.end() != it);
+	if (args->found)
+		args->self->set_module(make_child_module(it->second));
+	return p;
+}
+
+/**
+ * Make this evaluator evaluate in a fresh copy of the named snapshot.
+ * Nothing is re-evaluated and nothing is copied: the new environment
+ * sees the snapshot's bindings by reference, and its own defines go
+ * into a private module layered on top, so that other evaluators of
+ * the same snapshot never see them. (A set! of a binding that came
+ * from the snapshot is seen by all of them, as it would be for any
+ * shared module.) Passing the empty string returns the evaluator to
+ * the default, shared (guile-user) environment.
+ *
+ * Memoization and the compile cache are not used while a private
+ * environment is in effect.
+ */
+void SchemeEval::use_environment(const std::string& name)
+{
+	if (name.empty())
+	{
+		if (_in_eval) set_module(SCM_BOOL_F);
+		else scm_with_guile(c_wrap_drop_environment, this);
+		return;
+	}
+
+	UseArgs args{this, &name, false};
+	if (_in_eval)
+		c_wrap_use_environment(&args);
+	else
+		scm_with_guile(c_wrap_use_environment, &args);
+
+	if (not args.found)
+		throw RuntimeException(TRACE_INFO,
+			"No environment snapshot named \"%s\"", name.c_str());
+}
+
+void * SchemeEval::c_wrap_drop_environment(void * p)
+{
+	SchemeEval* self = (SchemeEval*) p;
+	self->set_module(SCM_BOOL_F);
+	return p;
+}
+
 /* ============================================================== */
 
 // A pool of scheme evaluators, sitting hot and ready to go.
@@ -1375,24 +4032,59 @@ void SchemeEval::set_scheme_as(AtomSpacePtr& as)
 	scm_with_guile(c_wrap_set_atomspace, as.get());
 }
 
-void SchemeEval::init_scheme(void)
+void* SchemeEval::c_wrap_init_scheme(void* p)
 {
-if (nullptr == fh) {
-struct stat sb;
-if (stat("/storage/emulated/0/Download", &sb) == 0 && S_ISDIR(sb.st_mode)) {
-    fh = fopen ("/storage/emulated/0/Download/datomspace-test.txt", "a+");
-} else {
-    fh = fopen ("/storage/sdcard0/Download/datomspace-test.txt", "a+");
+	std::lock_guard<std::mutex> lck(init_mtx);
+
+	// What the SchemeEval constructor (which init_scheme() used to
+	// run) and per_thread_init() would have done, on this thread.
+#ifdef WORK_AROUND_GUILE_UTF8_BUGS
+	scm_c_eval_string ("(setlocale LC_ALL \"\")\n");
+	scm_c_eval_string ("(setlocale LC_NUMERIC \"C\")\n");
+#endif // WORK_AROUND_GUILE_UTF8_BUGS
+	thread_is_inited = true;
+
+	SchemeSmob::init();
+	PrimitiveEnviron::init();
+	return p;
 }
+
+/**
+ * Start booting guile in the background, and return immediately.
+ * Call this as early as possible, e.g. while the application is
+ * still drawing its first screen; a later init_scheme() or the first
+ * SchemeEval constructor then only waits for whatever part of the
+ * boot has not yet finished.
+ */
+void SchemeEval::prewarm(void)
+{
+	start_immortal();
 }
 
+void SchemeEval::init_scheme(void)
+{
+if (nullptr == fh) fh = open_debug_file();
+
 fprintf(fh, "duude enter init_scheme tid=%d\n", gettid());
 fflush(fh);
 
-	// XXX FIXME only a subset is needed.
-	SchemeEval sch;
+	auto start = std::chrono::steady_clock::now();
+
+	// Only the core is set up here; everything else is autoloaded
+	// on first use (see install_autoloads()). In particular, there is
+	// no need to construct (and then destroy, with a forced garbage
+	// collection) a complete evaluator.
+	init_only_once();
+	scm_with_guile(c_wrap_init_scheme, NULL);
+
+	int64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count();
+	logger().info("[SchemeEval] init_scheme took %ld usecs "
+	              "(guile boot %ld usecs)", (long) usec,
+	              (long) guile_boot_usec);
 
-fprintf(fh, "duude exit init_scheme tid=%d, that=%p \n", gettid(), &sch);
+fprintf(fh, "duude exit init_scheme tid=%d usec=%ld\n",
+        gettid(), (long) usec);
 fflush(fh);
 fclose(fh);
 fh = nullptr;
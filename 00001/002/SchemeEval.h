@@ -0,0 +1,297 @@
+/*
+ * SchemeEval.h
+ *
+ * Simple scheme evaluator
+ * Copyright (c) 2008, 2014, 2015 Linas Vepstas <linas@linas.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_EVAL_H
+#define _OPENCOG_SCHEME_EVAL_H
+
+#include <condition_variable>
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <libguile.h>
+
+#include <opencog/util/concurrent_stack.h>
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/base/Handle.h>
+#include <opencog/atoms/truthvalue/TruthValue.h>
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/eval/GenericEval.h>
+#include <opencog/guile/SchemePrepared.h>
+#include <opencog/guile/SchemeStream.h>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+// Size of the low-memory reserve set aside by set_heap_limit().
+#ifndef SCHEME_OOM_RESERVE
+#define SCHEME_OOM_RESERVE (4*1024*1024)
+#endif
+
+class SchemeEval : public GenericEval
+{
+	friend class SchemePrepared;
+	friend class SchemeStream;
+	private:
+		// Make sure that guile is initialized.
+		static void * c_wrap_init_scheme(void *);
+
+		// Per-instance initialization and teardown.
+		void init(void);
+		static void * c_wrap_init(void *);
+		void per_thread_init(void);
+		void finish(void);
+		static void * c_wrap_finish(void *);
+
+		// Things related to the scheme shell.
+		bool _in_shell;
+		bool _in_eval;
+
+		// Redirection of the output port, when in the cogserver.
+		bool _in_server;
+		int _in_redirect;
+		SCM _pipe;
+		int _pipeno;
+		SCM _outport;
+		SCM _saved_outport;
+		void capture_port(void);
+		void redirect_output(void);
+		void restore_output(void);
+		void drain_output(void);
+		std::string poll_port(void);
+		size_t poll_port(std::string&, bool json = false);
+
+		// Interrupt support.
+		SCM _eval_thread;
+		pthread_t _eval_pthread;
+		static void * c_wrap_interrupt(void *);
+
+		// Evaluation of a string. The expression is only borrowed,
+		// for the duration of the call that was handed it.
+		std::string_view _pexpr;
+		std::string _answer;
+		size_t _answer_off;
+		static void * c_wrap_eval(void *);
+		static void * c_wrap_eval_many(void *);
+		void do_eval(std::string_view);
+		static void * c_wrap_poll(void *);
+		std::string do_poll_result(void);
+		void do_poll_result(std::string&);
+		volatile bool _eval_done;
+		volatile bool _poll_done;
+		std::mutex _poll_mtx;
+		std::condition_variable _wait_done;
+
+		SCM _rc;
+		void save_rc(SCM);
+		int _gc_ctr;
+
+		// Structured (JSON) results; see set_structured_results().
+		bool _structured;
+		bool structured_output(std::string&);
+		void structured_result(std::string&, SCM);
+
+		// Pipelined evaluation; see submit_expr().
+		struct EvalPipeline;
+		EvalPipeline* _pipeline;
+		void start_pipeline(size_t);
+		void stop_pipeline(void);
+		void pipeline_loop(void);
+		static void * c_wrap_pipeline(void *);
+
+		// Sampled logging of eval output, when in the cogserver.
+		static void log_eval_output(std::string&&, SCM);
+
+		// Evaluate expression, returning value.
+		bool _memoize;
+		ValuePtr _retval;
+		AtomSpace* _retas;
+		SchemeStreamPtr _retstream;
+		SchemePreparedPtr _retprep;
+		SCM do_string_eval(std::string_view, SCM);
+		static void * c_wrap_eval_v(void *);
+		static void * c_wrap_eval_as(void *);
+		static void * c_wrap_eval_stream(void *);
+		static void * c_wrap_prepare(void *);
+
+		// Apply function to arguments, returning Handle or TV.
+		Handle _hargs;
+		static void * c_wrap_apply_v(void *);
+		static void * c_wrap_apply_v_batch(void *);
+		SCM do_apply_scm(std::string_view func, const Handle& varargs);
+
+		// The module that this evaluator evaluates in, if it is not
+		// the default (guile-user); see use_environment().
+		SCM _module;
+		void set_module(SCM);
+		static void * c_wrap_snapshot(void *);
+		static void * c_wrap_use_environment(void *);
+		static void * c_wrap_drop_environment(void *);
+
+		// Error handling stuff.
+		SCM _scm_error_string;
+		SCM _captured_stack;
+		std::string _error_string;
+		std::string _error_msg;
+		std::string _error_key;
+		void set_captured_stack(SCM);
+		void set_error_string(SCM);
+		static SCM preunwind_handler_wrapper(void *, SCM, SCM);
+		static SCM catch_handler_wrapper(void *, SCM, SCM);
+		SCM preunwind_handler(SCM, SCM);
+		SCM catch_handler(SCM, SCM);
+
+		// Set per-thread AtomSpace.
+		AtomSpace* _atomspace;
+		static void * c_wrap_set_atomspace(void *);
+
+		// Evaluate an SCM expression, with the given evaluator. The
+		// source, if given, is what output logging reports as the
+		// expression that was evaluated, in place of the SCM argument
+		// (which may be a thunk, or an argument list).
+		SCM do_scm_eval(SCM, SCM (*)(void *), SCM source = SCM_UNDEFINED);
+
+	public:
+		SchemeEval(AtomSpace* = nullptr);
+		SchemeEval(AtomSpacePtr&);
+		~SchemeEval();
+
+		/// Return evaluator, for this thread and atomspace combination.
+		static SchemeEval* get_evaluator(AtomSpace* = nullptr);
+		static SchemeEval* get_evaluator(AtomSpacePtr&);
+
+		// Shell-style evaluation.
+		void begin_eval(void);
+		void eval_expr(std::string_view);
+		void eval_expr(const std::string& expr)
+		{
+			eval_expr(std::string_view(expr));
+		}
+		void eval_expr(const char* expr) { eval_expr(std::string_view(expr)); }
+		std::string poll_result(void);
+		const char* poll_result_borrow(size_t& len);
+		size_t poll_result(char* buf, size_t buflen);
+		void eval_many(const std::vector<std::string>& exprs,
+		               std::string& results,
+		               std::vector<size_t>& offsets);
+		void set_structured_results(bool);
+
+		// Pipelined, shell-style evaluation.
+		void set_pipeline_depth(size_t);
+		void submit_expr(const std::string&);
+		bool next_result(std::string&, bool wait = true);
+
+		// Evaluate expression, returning value.
+		ValuePtr eval_v(std::string_view);
+		ValuePtr eval_v(const std::stringstream& ss) { return eval_v(ss.str()); }
+		Handle eval_h(std::string_view str) { return HandleCast(eval_v(str)); }
+		Handle eval_h(const std::stringstream& ss) { return eval_h(ss.str()); }
+		TruthValuePtr eval_tv(std::string_view str)
+		{
+			return TruthValueCast(eval_v(str));
+		}
+		TruthValuePtr eval_tv(const std::stringstream& ss)
+		{
+			return eval_tv(ss.str());
+		}
+		AtomSpace* eval_as(std::string_view);
+		SchemeStreamPtr eval_stream(std::string_view, size_t chunk_size = 512);
+		SchemePreparedPtr prepare(std::string_view);
+
+		// Memoization of eval_v() results.
+		void set_memoize(bool);
+		static void invalidate_memo(void);
+		static std::string memo_stats(void);
+
+		// Apply expression to args, returning Handle or TV.
+		virtual ValuePtr apply_v(const std::string& func, Handle varargs);
+		Handle apply(const std::string& func, Handle varargs)
+		{
+			return HandleCast(apply_v(func, varargs));
+		}
+		TruthValuePtr apply_tv(const std::string& func, Handle varargs)
+		{
+			return TruthValueCast(apply_v(func, varargs));
+		}
+		std::vector<ValuePtr> apply_v_batch(const std::string& func,
+		                                    const HandleSeq& groundings,
+		                                    bool vectorized = false);
+
+		// Private environments, cloned from named snapshots.
+		void snapshot_environment(const std::string& name,
+		                          const std::string& prelude);
+		void use_environment(const std::string& name);
+
+		// Bridge between FloatValues and f64 bytevectors, copying the
+		// doubles in bulk. These must be called in guile mode.
+		static SCM float_value_to_bytevector(const ValuePtr&);
+		static ValuePtr bytevector_to_float_value(SCM);
+
+		// Validate and convert UTF-8 input, scrubbing out stray control
+		// characters if asked to. Must be called in guile mode.
+		static SCM utf8_to_scm(std::string_view, std::string& errmsg,
+		                       bool scrub = false);
+
+		// Printing of basic types.
+		static std::string prt(SCM);
+
+		// Nested invocations.
+		bool recursing(void) { return _in_eval; }
+
+		void interrupt(void);
+		static std::string interrupt_stats(void);
+
+		// Process-wide settings.
+		static void set_eval_cache(const std::string& dir, unsigned hot = 2);
+		static void set_output_logging(unsigned sample, unsigned max_per_sec);
+		static void set_heap_limit(size_t limit,
+		                           size_t reserve = SCHEME_OOM_RESERVE);
+		static void set_startup_heap(size_t bytes);
+		static void set_auto_compile(bool);
+
+		// C++ primitives, defined on first use of any of the names.
+		static void register_primitives(void (*define)(void),
+		                                std::initializer_list<const char*>);
+
+		static void set_scheme_as(AtomSpace*);
+		static void set_scheme_as(AtomSpacePtr&);
+		static void prewarm(void);
+		static void init_scheme(void);
+};
+
+/** @}*/
+}
+
+extern "C" {
+opencog::SchemeEval* get_scheme_evaluator(opencog::AtomSpace*);
+};
+
+#endif // _OPENCOG_SCHEME_EVAL_H
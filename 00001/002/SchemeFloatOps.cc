@@ -0,0 +1,493 @@
+/*
+ * SchemeFloatOps.cc
+ *
+ * Vectorized FloatValue and TruthValue arithmetic for scheme.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <vector>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FLOAT_OPS_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#include <libguile.h>
+
+#include <opencog/atoms/base/Atom.h>
+#include <opencog/atoms/truthvalue/TruthValue.h>
+#include <opencog/atoms/value/FloatValue.h>
+
+#include "SchemeEval.h"
+#include "SchemeFloatOps.h"
+#include "SchemeSmob.h"
+
+using namespace opencog;
+
+/* ============================================================== */
+/* Kernels. On x86, each has an AVX2 version that is compiled for
+ * AVX2 whatever the build flags, and is used only if the CPU has it;
+ * so one binary runs everywhere, and uses AVX2 where it can. The
+ * scalar loops are simple enough for the compiler to vectorize for
+ * the baseline target (SSE2, or e.g. NEON). */
+
+enum FloatOp { FLOAT_ADD, FLOAT_SUB, FLOAT_MUL, FLOAT_DIV };
+
+static inline double scalar_op(FloatOp op, double a, double b)
+{
+	switch (op)
+	{
+		case FLOAT_ADD: return a + b;
+		case FLOAT_SUB: return a - b;
+		case FLOAT_MUL: return a * b;
+		case FLOAT_DIV: return a / b;
+	}
+	return a;
+}
+
+#if defined(FLOAT_OPS_X86_DISPATCH)
+static bool cpu_has_avx2(void)
+{
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	return avx2;
+}
+
+__attribute__((target("avx2")))
+static inline __m256d avx_op(FloatOp op, __m256d a, __m256d b)
+{
+	switch (op)
+	{
+		case FLOAT_ADD: return _mm256_add_pd(a, b);
+		case FLOAT_SUB: return _mm256_sub_pd(a, b);
+		case FLOAT_MUL: return _mm256_mul_pd(a, b);
+		case FLOAT_DIV: return _mm256_div_pd(a, b);
+	}
+	return a;
+}
+
+__attribute__((target("avx2")))
+static inline double hsum(__m256d v)
+{
+	__m128d lo = _mm256_castpd256_pd128(v);
+	__m128d hi = _mm256_extractf128_pd(v, 1);
+	lo = _mm_add_pd(lo, hi);
+	return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2")))
+static void elementwise_avx2(FloatOp op, const double* a, const double* b,
+                             size_t bstride, double* out, size_t n)
+{
+	size_t i = 0;
+	if (0 == bstride)
+	{
+		__m256d vb = _mm256_set1_pd(*b);
+		for (; i + 4 <= n; i += 4)
+			_mm256_storeu_pd(out + i,
+				avx_op(op, _mm256_loadu_pd(a + i), vb));
+	}
+	else
+	{
+		for (; i + 4 <= n; i += 4)
+			_mm256_storeu_pd(out + i,
+				avx_op(op, _mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	}
+	for (; i < n; i++)
+		out[i] = scalar_op(op, a[i], b[i * bstride]);
+}
+
+__attribute__((target("avx2")))
+static double float_dot_avx2(const double* a, const double* b, size_t n)
+{
+	size_t i = 0;
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	for (; i + 8 <= n; i += 8)
+	{
+		acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(
+			_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(
+			_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+	}
+	double sum = hsum(_mm256_add_pd(acc0, acc1));
+	for (; i < n; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+__attribute__((target("avx2")))
+static double float_sum_avx2(const double* a, size_t n)
+{
+	size_t i = 0;
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	for (; i + 8 <= n; i += 8)
+	{
+		acc0 = _mm256_add_pd(acc0, _mm256_loadu_pd(a + i));
+		acc1 = _mm256_add_pd(acc1, _mm256_loadu_pd(a + i + 4));
+	}
+	double total = hsum(_mm256_add_pd(acc0, acc1));
+	for (; i < n; i++)
+		total += a[i];
+	return total;
+}
+
+/// Minimum (or maximum) of an array of at least 4 doubles.
+__attribute__((target("avx2")))
+static double float_extremum_avx2(const double* a, size_t n, bool want_max)
+{
+	size_t i = 4;
+	__m256d acc = _mm256_loadu_pd(a);
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256d v = _mm256_loadu_pd(a + i);
+		acc = want_max ? _mm256_max_pd(acc, v) : _mm256_min_pd(acc, v);
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, acc);
+	double best = lanes[0];
+	for (int j = 1; j < 4; j++)
+		best = want_max ? std::max(best, lanes[j]) : std::min(best, lanes[j]);
+	for (; i < n; i++)
+		best = want_max ? std::max(best, a[i]) : std::min(best, a[i]);
+	return best;
+}
+#endif // FLOAT_OPS_X86_DISPATCH
+
+/// out[i] = a[i] op b[i]; if bstride is zero, b is a single scalar.
+static void elementwise(FloatOp op, const double* a, const double* b,
+                        size_t bstride, double* out, size_t n)
+{
+#if defined(FLOAT_OPS_X86_DISPATCH)
+	if (cpu_has_avx2())
+	{
+		elementwise_avx2(op, a, b, bstride, out, n);
+		return;
+	}
+#endif
+	for (size_t i = 0; i < n; i++)
+		out[i] = scalar_op(op, a[i], b[i * bstride]);
+}
+
+static double float_dot(const double* a, const double* b, size_t n)
+{
+#if defined(FLOAT_OPS_X86_DISPATCH)
+	if (cpu_has_avx2())
+		return float_dot_avx2(a, b, n);
+#endif
+	double sum = 0.0;
+	for (size_t i = 0; i < n; i++)
+		sum += a[i] * b[i];
+	return sum;
+}
+
+static double float_sum(const double* a, size_t n)
+{
+#if defined(FLOAT_OPS_X86_DISPATCH)
+	if (cpu_has_avx2())
+		return float_sum_avx2(a, n);
+#endif
+	double total = 0.0;
+	for (size_t i = 0; i < n; i++)
+		total += a[i];
+	return total;
+}
+
+/// Minimum (or maximum) of a non-empty array.
+static double float_extremum(const double* a, size_t n, bool want_max)
+{
+#if defined(FLOAT_OPS_X86_DISPATCH)
+	if (8 <= n and cpu_has_avx2())
+		return float_extremum_avx2(a, n, want_max);
+#endif
+	double best = a[0];
+	for (size_t i = 1; i < n; i++)
+		best = want_max ? std::max(best, a[i]) : std::min(best, a[i]);
+	return best;
+}
+
+/* ============================================================== */
+/* Scheme wrappers. */
+
+// A scheme error is a longjmp, which skips C++ destructors. So every
+// argument is checked first, by functions that leave nothing with a
+// destructor live when they throw; only after that are ValuePtrs,
+// vectors and the like made.
+
+static bool is_float_value(SCM s)
+{
+	ValuePtr vp(SchemeSmob::scm_to_protom(s));
+	return nullptr != FloatValueCast(vp);
+}
+
+static size_t float_value_length(SCM s)
+{
+	FloatValuePtr fvp(FloatValueCast(SchemeSmob::scm_to_protom(s)));
+	return fvp->value().size();
+}
+
+/// Throw unless the argument is a FloatValue, or a bytevector holding
+/// a whole number of doubles. Return the number of doubles.
+static size_t check_operand(SCM s, const char* subr, int pos)
+{
+	if (scm_is_bytevector(s))
+	{
+		if (0 != SCM_BYTEVECTOR_LENGTH(s) % sizeof(double))
+			scm_wrong_type_arg_msg(subr, pos, s,
+				"f64vector (length a multiple of 8 bytes)");
+		return SCM_BYTEVECTOR_LENGTH(s) / sizeof(double);
+	}
+	if (not is_float_value(s))
+		scm_wrong_type_arg_msg(subr, pos, s, "FloatValue or f64vector");
+	return float_value_length(s);
+}
+
+static void check_lengths(const char* subr, size_t alen, size_t blen)
+{
+	if (alen == blen) return;
+	scm_misc_error(subr, "Length mismatch: ~A vs. ~A",
+		scm_list_2(scm_from_size_t(alen), scm_from_size_t(blen)));
+}
+
+/// The doubles in a FloatValue or an f64 bytevector, not copied.
+/// The `keep` member keeps the FloatValue alive while in use. The
+/// argument must have passed check_operand() already.
+struct Operand
+{
+	const double* data;
+	size_t len;
+	ValuePtr keep;
+};
+
+static Operand get_operand(SCM s)
+{
+	if (scm_is_bytevector(s))
+		return {(const double*) SCM_BYTEVECTOR_CONTENTS(s),
+		        SCM_BYTEVECTOR_LENGTH(s) / sizeof(double), nullptr};
+
+	ValuePtr vp(SchemeSmob::scm_to_protom(s));
+	const std::vector<double>& dbl = FloatValueCast(vp)->value();
+	return {dbl.data(), dbl.size(), vp};
+}
+
+static SCM float_op(FloatOp op, const char* subr, SCM sa, SCM sb)
+{
+	size_t alen = check_operand(sa, subr, 1);
+	bool scalar = scm_is_real(sb);
+	if (not scalar)
+		check_lengths(subr, alen, check_operand(sb, subr, 2));
+
+	ValuePtr result;
+	{
+		Operand a(get_operand(sa));
+		std::vector<double> out(a.len);
+		if (scalar)
+		{
+			double b = scm_to_double(sb);
+			elementwise(op, a.data, &b, 0, out.data(), a.len);
+		}
+		else
+		{
+			Operand b(get_operand(sb));
+			elementwise(op, a.data, b.data, 1, out.data(), a.len);
+		}
+		result = createFloatValue(std::move(out));
+	}
+	scm_remember_upto_here_2(sa, sb);
+	return SchemeSmob::protom_to_scm(result);
+}
+
+static SCM ss_float_add(SCM a, SCM b)
+{
+	return float_op(FLOAT_ADD, "cog-float-add", a, b);
+}
+
+static SCM ss_float_sub(SCM a, SCM b)
+{
+	return float_op(FLOAT_SUB, "cog-float-sub", a, b);
+}
+
+static SCM ss_float_mul(SCM a, SCM b)
+{
+	return float_op(FLOAT_MUL, "cog-float-mul", a, b);
+}
+
+static SCM ss_float_div(SCM a, SCM b)
+{
+	return float_op(FLOAT_DIV, "cog-float-div", a, b);
+}
+
+static double float_dot_scm(SCM sa, SCM sb)
+{
+	Operand a(get_operand(sa));
+	Operand b(get_operand(sb));
+	return float_dot(a.data, b.data, a.len);
+}
+
+static SCM ss_float_dot(SCM sa, SCM sb)
+{
+	check_lengths("cog-float-dot", check_operand(sa, "cog-float-dot", 1),
+		check_operand(sb, "cog-float-dot", 2));
+	double d = float_dot_scm(sa, sb);
+	scm_remember_upto_here_2(sa, sb);
+	return scm_from_double(d);
+}
+
+static double float_sum_scm(SCM sa)
+{
+	Operand a(get_operand(sa));
+	return float_sum(a.data, a.len);
+}
+
+static SCM ss_float_sum(SCM sa)
+{
+	check_operand(sa, "cog-float-sum", 1);
+	double s = float_sum_scm(sa);
+	scm_remember_upto_here_1(sa);
+	return scm_from_double(s);
+}
+
+static double float_extremum_of(SCM sa, bool want_max)
+{
+	Operand a(get_operand(sa));
+	return float_extremum(a.data, a.len, want_max);
+}
+
+static SCM float_extremum_scm(SCM sa, const char* subr, bool want_max)
+{
+	if (0 == check_operand(sa, subr, 1))
+		scm_misc_error(subr, "Empty vector has no extremum", SCM_EOL);
+	double x = float_extremum_of(sa, want_max);
+	scm_remember_upto_here_1(sa);
+	return scm_from_double(x);
+}
+
+static SCM ss_float_min(SCM sa)
+{
+	return float_extremum_scm(sa, "cog-float-min", false);
+}
+
+static SCM ss_float_max(SCM sa)
+{
+	return float_extremum_scm(sa, "cog-float-max", true);
+}
+
+static bool is_atom(SCM s)
+{
+	Handle h(HandleCast(SchemeSmob::scm_to_protom(s)));
+	return nullptr != h;
+}
+
+/// Throw unless the argument is a proper list of atoms.
+static void check_atom_list(SCM satoms, const char* subr)
+{
+	if (scm_is_false(scm_list_p(satoms)))
+		scm_wrong_type_arg_msg(subr, 1, satoms, "list of atoms");
+	for (SCM sl = satoms; scm_is_pair(sl); sl = SCM_CDR(sl))
+		if (not is_atom(SCM_CAR(sl)))
+			scm_wrong_type_arg_msg(subr, 1, SCM_CAR(sl), "list of atoms");
+}
+
+/// Gather the strengths and/or confidences of a list of atoms. The
+/// list must have passed check_atom_list() already.
+static void gather_tvs(SCM satoms,
+                       std::vector<double>* strengths,
+                       std::vector<double>* confidences)
+{
+	size_t n = scm_to_size_t(scm_length(satoms));
+	if (strengths) strengths->reserve(n);
+	if (confidences) confidences->reserve(n);
+
+	for (SCM sl = satoms; scm_is_pair(sl); sl = SCM_CDR(sl))
+	{
+		Handle h(HandleCast(SchemeSmob::scm_to_protom(SCM_CAR(sl))));
+		TruthValuePtr tv(h->getTruthValue());
+		if (strengths) strengths->push_back(tv->get_mean());
+		if (confidences) confidences->push_back(tv->get_confidence());
+	}
+}
+
+static ValuePtr tv_strengths(SCM satoms)
+{
+	std::vector<double> s;
+	gather_tvs(satoms, &s, nullptr);
+	return createFloatValue(std::move(s));
+}
+
+static SCM ss_tv_strengths(SCM satoms)
+{
+	check_atom_list(satoms, "cog-tv-strengths");
+	return SchemeSmob::protom_to_scm(tv_strengths(satoms));
+}
+
+static ValuePtr tv_confidences(SCM satoms)
+{
+	std::vector<double> c;
+	gather_tvs(satoms, nullptr, &c);
+	return createFloatValue(std::move(c));
+}
+
+static SCM ss_tv_confidences(SCM satoms)
+{
+	check_atom_list(satoms, "cog-tv-confidences");
+	return SchemeSmob::protom_to_scm(tv_confidences(satoms));
+}
+
+static double tv_weighted_mean(SCM satoms)
+{
+	std::vector<double> s, c;
+	gather_tvs(satoms, &s, &c);
+	double weight = float_sum(c.data(), c.size());
+	if (0.0 == weight) return 0.0;
+	return float_dot(s.data(), c.data(), s.size()) / weight;
+}
+
+static SCM ss_tv_weighted_mean(SCM satoms)
+{
+	check_atom_list(satoms, "cog-tv-weighted-mean");
+	return scm_from_double(tv_weighted_mean(satoms));
+}
+
+void opencog::define_float_ops(void)
+{
+	scm_c_define_gsubr("cog-float-add", 2, 0, 0, (scm_t_subr) ss_float_add);
+	scm_c_define_gsubr("cog-float-sub", 2, 0, 0, (scm_t_subr) ss_float_sub);
+	scm_c_define_gsubr("cog-float-mul", 2, 0, 0, (scm_t_subr) ss_float_mul);
+	scm_c_define_gsubr("cog-float-div", 2, 0, 0, (scm_t_subr) ss_float_div);
+	scm_c_define_gsubr("cog-float-dot", 2, 0, 0, (scm_t_subr) ss_float_dot);
+	scm_c_define_gsubr("cog-float-sum", 1, 0, 0, (scm_t_subr) ss_float_sum);
+	scm_c_define_gsubr("cog-float-min", 1, 0, 0, (scm_t_subr) ss_float_min);
+	scm_c_define_gsubr("cog-float-max", 1, 0, 0, (scm_t_subr) ss_float_max);
+	scm_c_define_gsubr("cog-tv-strengths", 1, 0, 0,
+		(scm_t_subr) ss_tv_strengths);
+	scm_c_define_gsubr("cog-tv-confidences", 1, 0, 0,
+		(scm_t_subr) ss_tv_confidences);
+	scm_c_define_gsubr("cog-tv-weighted-mean", 1, 0, 0,
+		(scm_t_subr) ss_tv_weighted_mean);
+}
+
+// Defined on first use, like the other primitive sets.
+static __attribute__((constructor)) void register_float_ops(void)
+{
+	SchemeEval::register_primitives(define_float_ops,
+		{"cog-float-add", "cog-float-sub", "cog-float-mul",
+		 "cog-float-div", "cog-float-dot", "cog-float-sum",
+		 "cog-float-min", "cog-float-max", "cog-tv-strengths",
+		 "cog-tv-confidences", "cog-tv-weighted-mean"});
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,61 @@
+/*
+ * SchemeFloatOps.h
+ *
+ * Vectorized FloatValue and TruthValue arithmetic for scheme.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_FLOAT_OPS_H
+#define _OPENCOG_SCHEME_FLOAT_OPS_H
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+/**
+ * Define the cog-float-* and cog-tv-* primitives. These work on whole
+ * FloatValues (or f64 bytevectors, see cog-value->f64vector) and on
+ * whole lists of atoms in one call, instead of on boxed flonums one
+ * at a time; the inner loops use AVX2 when the CPU has it.
+ * A bytevector must hold a whole number of doubles.
+ *
+ *   (cog-float-add A B)  (cog-float-sub A B)
+ *   (cog-float-mul A B)  (cog-float-div A B)
+ *       Element-wise; B may also be a plain number. Returns a
+ *       FloatValue.
+ *   (cog-float-dot A B)  (cog-float-sum A)
+ *   (cog-float-min A)    (cog-float-max A)
+ *       Reductions; return a number.
+ *   (cog-tv-strengths ATOMS)  (cog-tv-confidences ATOMS)
+ *       The truth value strengths (confidences) of a list of atoms,
+ *       as a FloatValue.
+ *   (cog-tv-weighted-mean ATOMS)
+ *       The confidence-weighted mean strength of a list of atoms.
+ *
+ * They are defined in the current module. This must be called in
+ * guile mode. It is registered with SchemeEval::register_primitives(),
+ * so that the primitives are defined the first time that any one of
+ * them is looked up; there is normally no need to call it directly.
+ */
+void define_float_ops(void);
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_FLOAT_OPS_H
@@ -0,0 +1,387 @@
+/*
+ * SchemeGCTrace.cc
+ *
+ * Garbage collection pause and stop-the-world timing.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <gc/gc.h>
+#include <libguile.h>
+
+#include "SchemeEval.h"
+#include "SchemeGCTrace.h"
+#include "SchemeTrace.h"
+
+using namespace opencog;
+
+// Threads that are timed per collection; any more are not recorded.
+#define GC_TRACE_THREADS 64
+
+// Collections that can be waiting for the after-gc hook to pick them
+// up. If the hook falls behind, the newest records are dropped.
+#define GC_TRACE_RING 256
+
+// log2 buckets, in microseconds: [0,1), [1,2), [2,4) ... [2^30, ...)
+#define GC_HIST_BUCKETS 32
+
+struct GCRecord
+{
+	int64_t start;          // collection started
+	int64_t stop_begin;     // stopping the world began
+	int64_t stopped;        // all threads stopped
+	int64_t restarted;      // all threads running again
+	int64_t end;            // collection finished
+	size_t heap_before;
+	size_t heap_after;
+
+	// Threads that the collector sent the suspend signal to, and when
+	// it sent it.
+	unsigned nsent;
+	uintptr_t sent_thread[GC_TRACE_THREADS];
+	int64_t sent[GC_TRACE_THREADS];
+
+	// Threads that took the signal, and when they did: the time to
+	// safepoint, for each thread. Retried signals show up more than
+	// once; only the first counts.
+	unsigned nacked;
+	uintptr_t acked_thread[GC_TRACE_THREADS];
+	int64_t acked[GC_TRACE_THREADS];
+};
+
+struct GCHistogram
+{
+	const char* name;
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+	std::atomic<uint64_t> bucket[GC_HIST_BUCKETS];
+};
+
+static GCHistogram hist_total{"gc-total-usec"};
+static GCHistogram hist_pause{"gc-pause-usec"};
+static GCHistogram hist_safepoint{"gc-safepoint-usec"};
+static GCHistogram hist_sent{"gc-signal-sent-usec"};
+static GCHistogram hist_acked{"gc-thread-stop-usec"};
+static GCHistogram* all_hists[] =
+	{ &hist_total, &hist_pause, &hist_safepoint, &hist_sent, &hist_acked };
+
+// The record being filled in; only touched from the GC callbacks,
+// which bdwgc calls with the allocation lock held.
+static GCRecord current;
+
+// Single producer (the collector), single consumer (the hook).
+static GCRecord ring[GC_TRACE_RING];
+static std::atomic<size_t> ring_head(0);
+static std::atomic<size_t> ring_tail(0);
+static std::atomic<size_t> ring_dropped(0);
+static std::mutex drain_mtx;
+
+// Written by the suspended threads, from their signal handlers, while
+// the world is being stopped; copied into `current` once it is.
+static std::atomic<unsigned> nacked(0);
+static uintptr_t acked_thread[GC_TRACE_THREADS];
+static int64_t acked[GC_TRACE_THREADS];
+
+static GC_on_collection_event_proc prev_collection_event = nullptr;
+static GC_on_thread_event_proc prev_thread_event = nullptr;
+static struct sigaction gc_suspend_action;
+
+static void hist_add(GCHistogram& h, int64_t usec)
+{
+	uint64_t v = (0 < usec) ? usec : 0;
+	unsigned b = 0;
+	while (b + 1 < GC_HIST_BUCKETS and (1ULL << b) <= v) b++;
+	h.bucket[b]++;
+	h.count++;
+	h.sum += v;
+	uint64_t m = h.max.load();
+	while (m < v and not h.max.compare_exchange_weak(m, v)) {}
+}
+
+// Bytes in use, read without taking the allocation lock, which the
+// caller already holds.
+static size_t heap_in_use(void)
+{
+	struct GC_prof_stats_s st;
+	GC_get_prof_stats_unsafe(&st, sizeof(st));
+	return st.heapsize_full - st.free_bytes_full - st.unmapped_bytes;
+}
+
+// Called by bdwgc, with the allocation lock held, and, between the
+// stop and the restart, with all other threads stopped. No malloc,
+// no locks, and no guile.
+static void GC_CALLBACK on_collection_event(GC_EventType ev)
+{
+	int64_t now = SchemeTrace::now_usec();
+	switch (ev)
+	{
+		case GC_EVENT_START:
+			current.start = now;
+			current.stop_begin = current.stopped = current.restarted = 0;
+			current.nsent = current.nacked = 0;
+			current.heap_before = heap_in_use();
+			break;
+		case GC_EVENT_PRE_STOP_WORLD:
+			current.stop_begin = now;
+			nacked.store(0);
+			break;
+		case GC_EVENT_POST_STOP_WORLD:
+		{
+			// Every thread has taken the signal by now; bdwgc waits
+			// for all of them before sending this.
+			current.stopped = now;
+			unsigned n = std::min(nacked.load(), (unsigned) GC_TRACE_THREADS);
+			for (unsigned i = 0; i < n; i++)
+			{
+				current.acked_thread[i] = acked_thread[i];
+				current.acked[i] = acked[i];
+			}
+			current.nacked = n;
+			break;
+		}
+		case GC_EVENT_POST_START_WORLD:
+			current.restarted = now;
+			break;
+		case GC_EVENT_END:
+		{
+			current.end = now;
+			current.heap_after = heap_in_use();
+
+			size_t head = ring_head.load(std::memory_order_relaxed);
+			if (GC_TRACE_RING <= head - ring_tail.load())
+			{
+				ring_dropped++;
+				break;
+			}
+			ring[head % GC_TRACE_RING] = current;
+			ring_head.store(head + 1, std::memory_order_release);
+			break;
+		}
+		default:
+			break;
+	}
+	if (prev_collection_event) prev_collection_event(ev);
+}
+
+// Despite its name, bdwgc sends GC_EVENT_THREAD_SUSPENDED as soon as
+// it has sent a thread the suspend signal, and not once the thread has
+// stopped; so this records when the signal went out.
+static void GC_CALLBACK on_thread_event(GC_EventType ev, void* thread_id)
+{
+	if (GC_EVENT_THREAD_SUSPENDED == ev and
+	    current.nsent < GC_TRACE_THREADS)
+	{
+		unsigned n = current.nsent++;
+		current.sent_thread[n] = (uintptr_t) thread_id;
+		current.sent[n] = SchemeTrace::now_usec();
+	}
+	if (prev_thread_event) prev_thread_event(ev, thread_id);
+}
+
+// Runs in each thread that the collector stops, when the suspend
+// signal arrives, just ahead of bdwgc's own handler, which goes on to
+// acknowledge the signal and wait. bdwgc has no hook of its own on
+// that side. Only async-signal-safe work here: a lock-free counter,
+// and the clock.
+static void on_suspend_signal(int sig, siginfo_t* info, void* context)
+{
+	int saved_errno = errno;
+	unsigned n = nacked.fetch_add(1);
+	if (n < GC_TRACE_THREADS)
+	{
+		acked_thread[n] = (uintptr_t) pthread_self();
+		acked[n] = SchemeTrace::now_usec();
+	}
+	errno = saved_errno;
+
+	if (gc_suspend_action.sa_flags & SA_SIGINFO)
+		gc_suspend_action.sa_sigaction(sig, info, context);
+	else if (SIG_DFL != gc_suspend_action.sa_handler and
+	         SIG_IGN != gc_suspend_action.sa_handler)
+		gc_suspend_action.sa_handler(sig);
+}
+
+// The first time, after the stop began, that the thread took the
+// signal; zero if it never did.
+static int64_t first_ack(const GCRecord& r, uintptr_t thread)
+{
+	for (unsigned i = 0; i < r.nacked; i++)
+		if (thread == r.acked_thread[i]) return r.acked[i];
+	return 0;
+}
+
+/// Move finished records into the histograms and the trace.
+static void drain(void)
+{
+	std::lock_guard<std::mutex> lck(drain_mtx);
+	size_t tail = ring_tail.load();
+	size_t head = ring_head.load(std::memory_order_acquire);
+	for (; tail != head; tail++)
+	{
+		const GCRecord& r = ring[tail % GC_TRACE_RING];
+		hist_add(hist_total, r.end - r.start);
+
+		bool stopped = 0 < r.stop_begin and 0 < r.stopped;
+		if (stopped)
+		{
+			hist_add(hist_safepoint, r.stopped - r.stop_begin);
+			if (0 < r.restarted)
+				hist_add(hist_pause, r.restarted - r.stop_begin);
+		}
+		for (unsigned i = 0; i < r.nsent; i++)
+		{
+			hist_add(hist_sent, r.sent[i] - r.stop_begin);
+			int64_t ack = first_ack(r, r.sent_thread[i]);
+			if (0 < ack)
+				hist_add(hist_acked, ack - r.stop_begin);
+		}
+
+		if (not SchemeTrace::enabled()) continue;
+
+		char detail[80];
+		snprintf(detail, sizeof(detail), "heap %zu -> %zu bytes",
+		         r.heap_before, r.heap_after);
+		SchemeTrace::complete("gc", r.start, r.end - r.start, detail);
+		if (stopped)
+		{
+			SchemeTrace::complete("gc-stop-world", r.stop_begin,
+			                      r.stopped - r.stop_begin);
+			if (0 < r.restarted)
+				SchemeTrace::complete("gc-world-stopped", r.stopped,
+				                      r.restarted - r.stopped);
+		}
+		for (unsigned i = 0; i < r.nsent; i++)
+		{
+			snprintf(detail, sizeof(detail), "thread %#lx",
+			         (unsigned long) r.sent_thread[i]);
+			SchemeTrace::complete("gc-signal-sent", r.stop_begin,
+			                      r.sent[i] - r.stop_begin, detail);
+			int64_t ack = first_ack(r, r.sent_thread[i]);
+			if (0 < ack)
+				SchemeTrace::complete("gc-thread-stop", r.stop_begin,
+				                      ack - r.stop_begin, detail);
+		}
+	}
+	ring_tail.store(tail);
+}
+
+// Guile runs this after every collection, in guile mode, where it is
+// safe to allocate again.
+static void* after_gc(void* hook_data, void* fn_data, void* data)
+{
+	drain();
+	return nullptr;
+}
+
+static SCM ss_gc_histograms(void)
+{
+	std::string h = SchemeGCTrace::histograms();
+	return scm_from_utf8_stringn(h.data(), h.size());
+}
+
+// Guile has initialized bdwgc by the time that any code runs in guile
+// mode; setting the callbacks before GC_init() is not supported. By
+// then, bdwgc has also installed its suspend signal handler, which
+// on_suspend_signal() is put in front of.
+void SchemeGCTrace::install(void)
+{
+	prev_collection_event = GC_get_on_collection_event();
+	GC_set_on_collection_event(on_collection_event);
+	prev_thread_event = GC_get_on_thread_event();
+	GC_set_on_thread_event(on_thread_event);
+
+	int sig = GC_get_suspend_signal();
+	if (0 < sig and 0 == sigaction(sig, nullptr, &gc_suspend_action))
+	{
+		struct sigaction act = gc_suspend_action;
+		act.sa_flags |= SA_SIGINFO;
+		act.sa_sigaction = on_suspend_signal;
+		sigaction(sig, &act, nullptr);
+	}
+
+	scm_c_hook_add(&scm_after_gc_c_hook, after_gc, nullptr, 0);
+}
+
+void SchemeGCTrace::define_primitives(void)
+{
+	scm_c_define_gsubr("cog-gc-histograms", 0, 0, 0,
+		(scm_t_subr) ss_gc_histograms);
+}
+
+// Defined on first use, like the other primitive sets.
+static __attribute__((constructor)) void register_gc_trace(void)
+{
+	SchemeEval::register_primitives(SchemeGCTrace::define_primitives,
+		{"cog-gc-histograms"});
+}
+
+std::string SchemeGCTrace::histograms(void)
+{
+	drain();
+
+	std::string rv;
+	char buf[120];
+	for (GCHistogram* h : all_hists)
+	{
+		snprintf(buf, sizeof(buf), "%s: count=%llu sum=%llu max=%llu",
+		         h->name, (unsigned long long) h->count.load(),
+		         (unsigned long long) h->sum.load(),
+		         (unsigned long long) h->max.load());
+		rv += buf;
+
+		// Print the bucket's lower bound, and its count.
+		for (unsigned b = 0; b < GC_HIST_BUCKETS; b++)
+		{
+			uint64_t n = h->bucket[b].load();
+			if (0 == n) continue;
+			snprintf(buf, sizeof(buf), " %llu:%llu",
+			         (0 == b) ? 0ULL : (1ULL << (b - 1)),
+			         (unsigned long long) n);
+			rv += buf;
+		}
+		rv += "\n";
+	}
+	snprintf(buf, sizeof(buf), "gc-records-dropped: %zu\n",
+	         ring_dropped.load());
+	rv += buf;
+	return rv;
+}
+
+void SchemeGCTrace::reset(void)
+{
+	std::lock_guard<std::mutex> lck(drain_mtx);
+	for (GCHistogram* h : all_hists)
+	{
+		h->count = 0;
+		h->sum = 0;
+		h->max = 0;
+		for (auto& b : h->bucket) b = 0;
+	}
+	ring_dropped = 0;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,73 @@
+/*
+ * SchemeGCTrace.h
+ *
+ * Garbage collection pause and stop-the-world timing.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_GC_TRACE_H
+#define _OPENCOG_SCHEME_GC_TRACE_H
+
+#include <string>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+/**
+ * Timing of every collection done by bdwgc: how long the collection
+ * took, how long the world was stopped, and how long it took to stop
+ * it (the time to safepoint). Per thread, two times are kept, both
+ * counted from when the stop began: when the collector sent that
+ * thread the suspend signal (gc-signal-sent), and when the thread took
+ * the signal and stopped (gc-thread-stop). The heap in use before and
+ * after is recorded, too.
+ *
+ * The bdwgc collection and thread event callbacks run with the world
+ * stopped, and the suspend signal handler in the thread being
+ * stopped, and so they only write into fixed, preallocated storage.
+ * The records are later picked up by guile's after-gc hook, which
+ * turns them into SchemeTrace events (when tracing is on), and into
+ * log2 histograms, which are always kept.
+ */
+class SchemeGCTrace
+{
+	public:
+		/// Start timing collections, and hook into guile. Must be
+		/// called once, in guile mode: the bdwgc callbacks can only
+		/// be set once the collector has been initialized, and so the
+		/// collections done while guile boots are not seen.
+		static void install(void);
+
+		/// Define (cog-gc-histograms) in the current module. This is
+		/// registered with SchemeEval::register_primitives(), and done
+		/// on first use.
+		static void define_primitives(void);
+
+		/// The histograms, as text, one line per measure.
+		static std::string histograms(void);
+
+		/// Clear the histograms.
+		static void reset(void);
+};
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_GC_TRACE_H
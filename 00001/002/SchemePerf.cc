@@ -0,0 +1,432 @@
+/*
+ * SchemePerf.cc
+ *
+ * Hardware performance counters, per evaluation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <opencog/util/Logger.h>
+
+#include "SchemePerf.h"
+
+using namespace opencog;
+
+// Templates are cut off at this length.
+#define PERF_TEMPLATE_MAX 160
+
+// Beyond this many distinct templates, the rest are lumped together.
+#define PERF_MAX_TEMPLATES 1000
+
+enum { INSTRUCTIONS, CYCLES, CACHE_MISSES, BRANCH_MISSES, PAGE_FAULTS };
+
+static const struct
+{
+	const char* name;
+	uint32_t type;
+	uint64_t config;
+} counters[PERF_NCOUNTERS] = {
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	{ "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	{ "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+
+// The counter group of one thread. Readings are laid out as
+// [time enabled, time running, counters...], with zero for any
+// counter that could not be opened.
+struct PerfGroup
+{
+	int fd[PERF_NCOUNTERS];
+	int slot[PERF_NCOUNTERS];
+	int nopen;
+	bool tried;
+
+	PerfGroup() : nopen(0), tried(false)
+	{
+		for (int i = 0; i < PERF_NCOUNTERS; i++) fd[i] = slot[i] = -1;
+	}
+	~PerfGroup()
+	{
+		for (int i = 0; i < PERF_NCOUNTERS; i++)
+			if (0 <= fd[i]) close(fd[i]);
+	}
+};
+
+struct PerfTotals
+{
+	uint64_t count = 0;
+	uint64_t v[PERF_NCOUNTERS] = {};
+};
+
+std::atomic<bool> SchemePerf::_enabled(false);
+
+static std::mutex perf_mtx;
+static std::unordered_map<std::string, PerfTotals> by_template;
+static std::map<const void*, PerfTotals> by_evaluator;
+static std::atomic_flag warned = ATOMIC_FLAG_INIT;
+
+static thread_local PerfGroup group;
+
+static int perf_open(uint32_t type, uint64_t config, int group_fd)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP |
+		PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd,
+	               PERF_FLAG_FD_CLOEXEC);
+}
+
+// Open as many of the counters as will open. The first one to open
+// leads the group, so that all are read together, with one syscall.
+static PerfGroup& thread_group(void)
+{
+	if (group.tried) return group;
+	group.tried = true;
+
+	int leader = -1;
+	int err = 0;
+	for (int i = 0; i < PERF_NCOUNTERS; i++)
+	{
+		int fd = perf_open(counters[i].type, counters[i].config, leader);
+		if (fd < 0)
+		{
+			if (0 == err) err = errno;
+			continue;
+		}
+		if (leader < 0) leader = fd;
+		group.fd[i] = fd;
+		group.slot[i] = group.nopen++;
+	}
+
+	if (PERF_NCOUNTERS == group.nopen or warned.test_and_set())
+		return group;
+
+	if (0 == group.nopen)
+		logger().warn("[SchemePerf] perf_event_open failed: %s; no "
+		              "counts will be taken. Check "
+		              "/proc/sys/kernel/perf_event_paranoid\n",
+		              strerror(err));
+	else
+	{
+		std::string missing;
+		for (int i = 0; i < PERF_NCOUNTERS; i++)
+			if (group.fd[i] < 0)
+				missing += std::string(" ") + counters[i].name;
+		logger().info("[SchemePerf] Not available, counted as zero:%s\n",
+		              missing.c_str());
+	}
+	return group;
+}
+
+static bool read_group(PerfGroup& g, uint64_t* out)
+{
+	uint64_t buf[3 + PERF_NCOUNTERS];
+	int leader = -1;
+	for (int i = 0; i < PERF_NCOUNTERS; i++)
+		if (0 <= g.fd[i]) { leader = g.fd[i]; break; }
+	if (leader < 0) return false;
+
+	ssize_t len = (3 + g.nopen) * sizeof(uint64_t);
+	if (len != read(leader, buf, len)) return false;
+
+	out[0] = buf[1];
+	out[1] = buf[2];
+	for (int i = 0; i < PERF_NCOUNTERS; i++)
+		out[2 + i] = (0 <= g.slot[i]) ? buf[3 + g.slot[i]] : 0;
+	return true;
+}
+
+// Characters that end a token, as in the scheme reader.
+static inline bool is_delimiter(char c)
+{
+	return isspace((unsigned char) c) or
+		('\0' != c and nullptr != strchr("()[]\";'`,", c));
+}
+
+static inline bool is_radix_digit(char c, int radix)
+{
+	if (16 == radix) return isxdigit((unsigned char) c);
+	return '0' <= c and c < '0' + radix;
+}
+
+/// Scan an unsigned real (integer, ratio or decimal) starting at t[i],
+/// advancing i past it. Return false if there is none.
+static bool scan_ureal(std::string_view t, size_t& i, int radix)
+{
+	size_t start = i;
+	while (i < t.size() and is_radix_digit(t[i], radix)) i++;
+	size_t ndigits = i - start;
+
+	if (i < t.size() and '/' == t[i])
+	{
+		if (0 == ndigits) return false;
+		size_t denom = ++i;
+		while (i < t.size() and is_radix_digit(t[i], radix)) i++;
+		return denom < i;
+	}
+	if (10 != radix) return 0 < ndigits;
+
+	if (i < t.size() and '.' == t[i])
+	{
+		size_t frac = ++i;
+		while (i < t.size() and isdigit((unsigned char) t[i])) i++;
+		ndigits += i - frac;
+	}
+	if (0 == ndigits) return false;
+
+	if (i < t.size() and ('e' == t[i] or 'E' == t[i]))
+	{
+		size_t e = i + 1;
+		if (e < t.size() and ('+' == t[e] or '-' == t[e])) e++;
+		size_t edigits = e;
+		while (e < t.size() and isdigit((unsigned char) t[e])) e++;
+		if (edigits < e) i = e;
+	}
+	return true;
+}
+
+/// Scan an optionally signed real, or +inf.0, -inf.0, +nan.0.
+static bool scan_real(std::string_view t, size_t& i, int radix)
+{
+	if (i < t.size() and ('+' == t[i] or '-' == t[i]))
+	{
+		std::string_view rest = t.substr(i + 1, 5);
+		if ("inf.0" == rest or "nan.0" == rest)
+		{
+			i += 6;
+			return true;
+		}
+		i++;
+	}
+	return scan_ureal(t, i, radix);
+}
+
+/// True if the reader would take the whole token as a number. Symbols
+/// that start out like numbers, such as 1+ or -1- or ..., are not.
+static bool is_number(std::string_view t)
+{
+	int radix = 10;
+	size_t i = 0;
+	while (i + 1 < t.size() and '#' == t[i])
+	{
+		switch (tolower((unsigned char) t[i+1]))
+		{
+			case 'x': radix = 16; break;
+			case 'o': radix = 8; break;
+			case 'b': radix = 2; break;
+			case 'd': radix = 10; break;
+			case 'e': case 'i': break;
+			default: return false;
+		}
+		i += 2;
+	}
+
+	size_t start = i;
+	bool signed_start = i < t.size() and ('+' == t[i] or '-' == t[i]);
+	if (not scan_real(t, i, radix))
+		return signed_start and start + 2 == t.size() and 'i' == t[start+1];
+
+	if (i == t.size()) return true;
+
+	// Polar, rectangular, and pure imaginary complex numbers.
+	if ('@' == t[i])
+		return scan_real(t, ++i, radix) and i == t.size();
+	if ('+' == t[i] or '-' == t[i])
+	{
+		size_t j = i;
+		if (not scan_real(t, j, radix)) j = i + 1;
+		return j + 1 == t.size() and 'i' == t[j];
+	}
+	return signed_start and i + 1 == t.size() and 'i' == t[i];
+}
+
+/// Blank out string and number literals, and collapse whitespace, so
+/// that expressions differing only in their data fall together. The
+/// expression is split into tokens the way the reader splits it, and
+/// only tokens that read as numbers are blanked.
+static std::string expr_template(std::string_view expr)
+{
+	std::string t;
+	size_t i = 0;
+	while (i < expr.size() and t.size() < PERF_TEMPLATE_MAX)
+	{
+		char c = expr[i];
+		if ('"' == c)
+		{
+			for (i++; i < expr.size() and '"' != expr[i]; i++)
+				if ('\\' == expr[i]) i++;
+			i++;
+			t += "\"\"";
+		}
+		else if (isspace((unsigned char) c))
+		{
+			if (not t.empty() and ' ' != t.back()) t += ' ';
+			i++;
+		}
+		else if (is_delimiter(c))
+		{
+			t += c;
+			i++;
+		}
+		else
+		{
+			size_t end = i;
+			while (end < expr.size() and not is_delimiter(expr[end])) end++;
+			std::string_view tok = expr.substr(i, end - i);
+			if (is_number(tok)) t += '#';
+			else t += tok;
+			i = end;
+		}
+	}
+
+	// Don't cut a UTF-8 sequence in two.
+	if (PERF_TEMPLATE_MAX < t.size())
+	{
+		size_t n = PERF_TEMPLATE_MAX;
+		while (0 < n and 0x80 == (t[n] & 0xc0)) n--;
+		t.resize(n);
+	}
+	while (not t.empty() and ' ' == t.back()) t.pop_back();
+	return t;
+}
+
+void SchemePerf::enable(bool on)
+{
+	_enabled = on;
+}
+
+void SchemePerf::Scope::begin(const void* evaluator, std::string_view expr)
+{
+	PerfGroup& g = thread_group();
+	if (0 == g.nopen) return;
+
+	_evaluator = evaluator;
+	_key = expr_template(expr);
+	_on = read_group(g, _start);
+}
+
+void SchemePerf::Scope::end(void)
+{
+	uint64_t now[PERF_NCOUNTERS + 2];
+	if (not read_group(group, now)) return;
+
+	// If the counters were multiplexed with others, scale up to the
+	// whole time that they were enabled.
+	uint64_t enabled = now[0] - _start[0];
+	uint64_t running = now[1] - _start[1];
+	double scale = (0 < running and running < enabled) ?
+		(double) enabled / running : 1.0;
+
+	uint64_t delta[PERF_NCOUNTERS];
+	for (int i = 0; i < PERF_NCOUNTERS; i++)
+		delta[i] = (uint64_t) ((now[2 + i] - _start[2 + i]) * scale);
+
+	std::lock_guard<std::mutex> lck(perf_mtx);
+	auto it = by_template.find(_key);
+	if (by_template.end() == it)
+	{
+		if (PERF_MAX_TEMPLATES <= by_template.size())
+			_key = "(other)";
+		it = by_template.emplace(_key, PerfTotals()).first;
+	}
+	PerfTotals* totals[2] = { &it->second, &by_evaluator[_evaluator] };
+	for (PerfTotals* pt : totals)
+	{
+		pt->count++;
+		for (int i = 0; i < PERF_NCOUNTERS; i++)
+			pt->v[i] += delta[i];
+	}
+}
+
+static void print_totals(std::string& rv, const char* label,
+                         const PerfTotals& pt)
+{
+	double instr = pt.v[INSTRUCTIONS];
+	double ipc = (0 < pt.v[CYCLES]) ? instr / pt.v[CYCLES] : 0.0;
+	double kinstr = (0 < instr) ? instr / 1000.0 : 1.0;
+
+	char buf[300];
+	snprintf(buf, sizeof(buf),
+		"%s\n    n=%llu instructions=%llu cycles=%llu ipc=%.2f "
+		"cache-mpki=%.2f branch-mpki=%.2f page-faults=%llu\n",
+		label, (unsigned long long) pt.count,
+		(unsigned long long) pt.v[INSTRUCTIONS],
+		(unsigned long long) pt.v[CYCLES], ipc,
+		pt.v[CACHE_MISSES] / kinstr, pt.v[BRANCH_MISSES] / kinstr,
+		(unsigned long long) pt.v[PAGE_FAULTS]);
+	rv += buf;
+}
+
+std::string SchemePerf::report(size_t top)
+{
+	std::lock_guard<std::mutex> lck(perf_mtx);
+
+	std::vector<const std::pair<const std::string, PerfTotals>*> sorted;
+	for (const auto& pr : by_template) sorted.push_back(&pr);
+	std::sort(sorted.begin(), sorted.end(), [](auto a, auto b)
+		{ return a->second.v[CYCLES] > b->second.v[CYCLES]; });
+	if (top < sorted.size()) sorted.resize(top);
+
+	std::string rv = "By expression template:\n";
+	for (auto pr : sorted)
+		print_totals(rv, pr->first.c_str(), pr->second);
+
+	rv += "By evaluator:\n";
+	for (const auto& pr : by_evaluator)
+	{
+		char label[40];
+		snprintf(label, sizeof(label), "%p", pr.first);
+		print_totals(rv, label, pr.second);
+	}
+	return rv;
+}
+
+void SchemePerf::forget(const void* evaluator)
+{
+	std::lock_guard<std::mutex> lck(perf_mtx);
+	by_evaluator.erase(evaluator);
+}
+
+void SchemePerf::reset(void)
+{
+	std::lock_guard<std::mutex> lck(perf_mtx);
+	by_template.clear();
+	by_evaluator.clear();
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,106 @@
+/*
+ * SchemePerf.h
+ *
+ * Hardware performance counters, per evaluation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_PERF_H
+#define _OPENCOG_SCHEME_PERF_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+#define PERF_NCOUNTERS 5
+
+/**
+ * Count instructions, cycles, cache misses, branch misses and page
+ * faults around each evaluation, with a perf_event_open() counter
+ * group per thread, and add them up per expression template and per
+ * evaluator. The expression template is the expression text with
+ * string and number literals blanked out and whitespace collapsed,
+ * so that (foo "a" 1) and (foo "b" 2) are counted together. A high
+ * cache-miss rate per instruction and a low instructions-per-cycle
+ * marks memory-bound code; the reverse marks compute-bound code.
+ *
+ * This is off by default; turn it on with enable(), or by setting
+ * COG_SCHEME_PERF. Only user-space events of the calling thread are
+ * counted, so this works without root when perf_event_paranoid is 2
+ * or less. Counters that cannot be opened (no PMU in a VM, say) are
+ * left out; if none can be, then nothing is counted, and a warning
+ * is logged once.
+ *
+ * Nested evaluations are counted both on their own and as part of
+ * the evaluation that contains them.
+ */
+class SchemePerf
+{
+	private:
+		static std::atomic<bool> _enabled;
+
+	public:
+		/// Count the events between construction and destruction.
+		class Scope
+		{
+			private:
+				const void* _evaluator;
+				std::string _key;
+				uint64_t _start[PERF_NCOUNTERS + 2];
+				bool _on;
+
+			public:
+				Scope(const void* evaluator, std::string_view expr)
+					: _on(false)
+				{
+					if (enabled()) begin(evaluator, expr);
+				}
+				~Scope()
+				{
+					if (_on) end();
+				}
+				void begin(const void*, std::string_view);
+				void end(void);
+		};
+
+		static bool enabled(void)
+		{
+			return _enabled.load(std::memory_order_relaxed);
+		}
+		static void enable(bool);
+
+		/// Drop the totals for an evaluator that is going away.
+		static void forget(const void* evaluator);
+
+		/// The totals, as text: the `top` templates that used the
+		/// most cycles, and then each evaluator.
+		static std::string report(size_t top = 20);
+
+		static void reset(void);
+};
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_PERF_H
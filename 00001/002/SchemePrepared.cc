@@ -0,0 +1,186 @@
+/*
+ * SchemePrepared.cc
+ *
+ * Prepared, parameterized scheme procedures.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/exceptions.h>
+
+#include "SchemeEval.h"
+#include "SchemePrepared.h"
+#include "SchemeSmob.h"
+
+using namespace opencog;
+
+/// This must be called in guile mode.
+SchemePrepared::SchemePrepared(SchemeEval* ev, SCM proc, SCM source) :
+	_evaluator(ev),
+	_proc(scm_gc_protect_object(proc)),
+	_source(scm_gc_protect_object(source))
+{
+}
+
+SchemePrepared::~SchemePrepared()
+{
+	scm_with_guile(c_wrap_release, this);
+}
+
+void* SchemePrepared::c_wrap_release(void* p)
+{
+	SchemePrepared* self = (SchemePrepared*) p;
+	scm_gc_unprotect_object(self->_proc);
+	scm_gc_unprotect_object(self->_source);
+	self->_proc = SCM_BOOL_F;
+	self->_source = SCM_BOOL_F;
+	return self;
+}
+
+SchemePrepared& SchemePrepared::bind(const Handle& h)
+{
+	return bind(ValuePtr(h));
+}
+
+SchemePrepared& SchemePrepared::bind(const ValuePtr& v)
+{
+	Arg arg;
+	arg.kind = Arg::VALUE;
+	arg.value = v;
+	_args.emplace_back(std::move(arg));
+	return *this;
+}
+
+SchemePrepared& SchemePrepared::bind(const std::string& str)
+{
+	Arg arg;
+	arg.kind = Arg::STRING;
+	arg.str = str;
+	_args.emplace_back(std::move(arg));
+	return *this;
+}
+
+SchemePrepared& SchemePrepared::bind(const char* str)
+{
+	return bind(std::string(str));
+}
+
+SchemePrepared& SchemePrepared::bind(double d)
+{
+	Arg arg;
+	arg.kind = Arg::DOUBLE;
+	arg.dbl = d;
+	_args.emplace_back(std::move(arg));
+	return *this;
+}
+
+SchemePrepared& SchemePrepared::bind(bool b)
+{
+	Arg arg;
+	arg.kind = Arg::BOOL;
+	arg.i64 = b;
+	_args.emplace_back(std::move(arg));
+	return *this;
+}
+
+SchemePrepared& SchemePrepared::bind_int(int64_t i)
+{
+	Arg arg;
+	arg.kind = Arg::INT;
+	arg.i64 = i;
+	_args.emplace_back(std::move(arg));
+	return *this;
+}
+
+SchemePrepared& SchemePrepared::bind_uint(uint64_t u)
+{
+	Arg arg;
+	arg.kind = Arg::UINT;
+	arg.u64 = u;
+	_args.emplace_back(std::move(arg));
+	return *this;
+}
+
+// Runs inside the evaluator's catch, so that a bad argument (a string
+// that is not valid UTF-8) is reported like any other error. Strings
+// are data, not shell input: they are validated, but passed verbatim,
+// control characters and all. Nothing with a destructor is live when
+// scm_misc_error() throws.
+SCM SchemePrepared::apply(void* p)
+{
+	SchemePrepared* self = (SchemePrepared*) scm_to_pointer((SCM) p);
+
+	// Cons in reverse, so that the list comes out in order.
+	SCM args = SCM_EOL;
+	for (size_t i = self->_args.size(); 0 < i; i--)
+	{
+		const Arg& arg = self->_args[i-1];
+		SCM sarg = SCM_EOL;
+		switch (arg.kind)
+		{
+			case Arg::VALUE:
+				sarg = SchemeSmob::protom_to_scm(arg.value); break;
+			case Arg::STRING:
+				sarg = SchemeEval::utf8_to_scm(arg.str, self->_errmsg);
+				if (scm_is_false(sarg))
+					scm_misc_error("exec", "Argument ~A: ~A",
+						scm_list_2(scm_from_size_t(i),
+							scm_from_utf8_string(self->_errmsg.c_str())));
+				break;
+			case Arg::DOUBLE:
+				sarg = scm_from_double(arg.dbl); break;
+			case Arg::INT:
+				sarg = scm_from_int64(arg.i64); break;
+			case Arg::UINT:
+				sarg = scm_from_uint64(arg.u64); break;
+			case Arg::BOOL:
+				sarg = scm_from_bool(arg.i64); break;
+		}
+		args = scm_cons(sarg, args);
+	}
+	return scm_apply_0(self->_proc, args);
+}
+
+void* SchemePrepared::c_wrap_exec(void* p)
+{
+	SchemePrepared* self = (SchemePrepared*) p;
+	SCM rc = self->_evaluator->do_scm_eval(scm_from_pointer(self, nullptr),
+	                                       apply, self->_source);
+	if (self->_evaluator->eval_error()) return self;
+
+	self->_retval = SchemeSmob::scm_to_protom(rc);
+	return self;
+}
+
+ValuePtr SchemePrepared::exec(void)
+{
+	bool recursing = _evaluator->_in_eval;
+	_evaluator->_in_eval = true;
+	scm_with_guile(c_wrap_exec, this);
+	_evaluator->_in_eval = recursing;
+	_args.clear();
+
+	if (_evaluator->eval_error())
+		throw RuntimeException(TRACE_INFO, "%s",
+			_evaluator->_error_msg.c_str());
+
+	// Don't hold on to the result after returning it.
+	ValuePtr rv;
+	swap(rv, _retval);
+	return rv;
+}
+
+/* ===================== END OF FILE ============================ */
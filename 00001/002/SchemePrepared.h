@@ -0,0 +1,122 @@
+/*
+ * SchemePrepared.h
+ *
+ * Prepared, parameterized scheme procedures.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_PREPARED_H
+#define _OPENCOG_SCHEME_PREPARED_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <libguile.h>
+#include <opencog/atoms/base/Handle.h>
+#include <opencog/atoms/value/Value.h>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+class SchemeEval;
+
+/**
+ * A scheme procedure, compiled once by SchemeEval::prepare(), that
+ * can then be called any number of times with arguments bound from
+ * C++. The arguments are converted directly into SCM values; there is
+ * no string formatting, reading or compiling per call. For example:
+ *
+ *    SchemePreparedPtr p = ev->prepare(
+ *        "(lambda (name w) (cog-set-value! (Concept name) key w))");
+ *    p->bind("cat").bind(0.5).exec();
+ *
+ * Like the evaluator that made it, a prepared procedure is meant to
+ * be used from one thread at a time.
+ */
+class SchemePrepared
+{
+	friend class SchemeEval;
+	private:
+		struct Arg
+		{
+			enum { VALUE, STRING, DOUBLE, INT, UINT, BOOL } kind;
+			ValuePtr value;
+			std::string str;
+			double dbl;
+			int64_t i64;
+			uint64_t u64;
+		};
+
+		SchemeEval* _evaluator;
+		SCM _proc;
+		SCM _source;   // The text that was prepared, for logging.
+		std::vector<Arg> _args;
+		ValuePtr _retval;
+		std::string _errmsg;
+
+		SchemePrepared& bind_int(int64_t);
+		SchemePrepared& bind_uint(uint64_t);
+
+		static SCM apply(void*);
+		static void* c_wrap_exec(void*);
+		static void* c_wrap_release(void*);
+
+	public:
+		SchemePrepared(SchemeEval*, SCM proc, SCM source);
+		~SchemePrepared();
+		SchemePrepared(const SchemePrepared&) = delete;
+		SchemePrepared& operator=(const SchemePrepared&) = delete;
+
+		/// Bind the next positional argument.
+		SchemePrepared& bind(const Handle&);
+		SchemePrepared& bind(const ValuePtr&);
+		SchemePrepared& bind(const std::string&);
+		SchemePrepared& bind(const char*);
+		SchemePrepared& bind(double);
+		SchemePrepared& bind(bool);
+
+		/// Integers of any width and signedness are bound exactly,
+		/// without overload ambiguity between int, long and size_t.
+		template<typename T>
+		typename std::enable_if<std::is_integral<T>::value,
+		                        SchemePrepared&>::type
+		bind(T i)
+		{
+			if (std::is_signed<T>::value) return bind_int((int64_t) i);
+			return bind_uint((uint64_t) i);
+		}
+
+		/// Forget all bound arguments.
+		void clear(void) { _args.clear(); }
+
+		/// Call the procedure with the bound arguments, and clear the
+		/// bindings. Evaluation errors are thrown as exceptions.
+		ValuePtr exec(void);
+};
+
+typedef std::shared_ptr<SchemePrepared> SchemePreparedPtr;
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_PREPARED_H
@@ -0,0 +1,330 @@
+/*
+ * SchemeSlicer.cc
+ *
+ * Cooperative time-slicing of many scheme sessions over a few threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/platform.h>
+
+#include "SchemeEval.h"
+#include "SchemeSlicer.h"
+#include "SchemeSmob.h"
+
+using namespace opencog;
+
+// The scheme half of the slicer: a list of three procedures, sharing
+// one prompt tag. `run` starts evaluating a string, `resume` continues
+// a suspended evaluation, and `make-yield` makes the async that
+// suspends it. Both `run` and `resume` return either (done . text) or
+// (yield . k) where k is the continuation to resume later. The async
+// runs at some later safe point, by which time the worker may have
+// moved on to another slice, or be outside of any prompt; so it checks
+// first that the slice it was made for is still the one running, and
+// that there is a prompt to suspend to.
+static const char* slicer_scm =
+	"(let* ((tag (make-prompt-tag \"cog-slice\"))"
+	"       (suspend (lambda (k) (cons 'yield k)))"
+	"       (render (lambda (port v)"
+	"         (string-append (get-output-string port)"
+	"           (if (unspecified? v) \"\" (format #f \"~a\" v)) \"\\n\")))"
+	"       (report (lambda (port key args)"
+	"         (string-append (get-output-string port)"
+	"           (call-with-output-string"
+	"             (lambda (p) (print-exception p #f key args)))"
+	"           \"ABORT: \" (format #f \"~a\" key) \"\\n\"))))"
+	"  (list"
+	"    (lambda (str port)"
+	"      (call-with-prompt tag"
+	"        (lambda ()"
+	"          (catch #t"
+	"            (lambda ()"
+	"              (cons 'done (render port"
+	"                (with-output-to-port port"
+	"                  (lambda ()"
+	"                    ((@ (ice-9 eval-string) eval-string) str"
+	"                      #:module (resolve-module '(guile-user))))))))"
+	"            (lambda (key . args) (cons 'done (report port key args)))))"
+	"        suspend))"
+	"    (lambda (k) (call-with-prompt tag k suspend))"
+	"    (lambda (current? worker slice)"
+	"      (lambda ()"
+	"        (when (and (current? worker slice)"
+	"                   (suspendable-continuation? tag))"
+	"          (abort-to-prompt tag))))))";
+
+static SCM slice_run = SCM_BOOL_F;
+static SCM slice_resume = SCM_BOOL_F;
+static SCM slice_make_yield = SCM_BOOL_F;
+static SCM slice_current_p = SCM_BOOL_F;
+static SCM sym_yield = SCM_BOOL_F;
+static std::once_flag slicer_once;
+
+// Is the worker still running the given slice?
+SCM SchemeSlicer::ss_current_p(SCM worker, SCM slice)
+{
+	Worker* w = (Worker*) scm_to_pointer(worker);
+	return scm_from_bool(nullptr != w->running.load() and
+	                     scm_to_uint64(slice) == w->slice.load());
+}
+
+void* SchemeSlicer::init_slicer_scm(void*)
+{
+	SCM procs = scm_c_eval_string(slicer_scm);
+	slice_run = scm_gc_protect_object(scm_list_ref(procs, scm_from_int(0)));
+	slice_resume = scm_gc_protect_object(scm_list_ref(procs, scm_from_int(1)));
+	slice_make_yield = scm_gc_protect_object(scm_list_ref(procs, scm_from_int(2)));
+	slice_current_p = scm_gc_protect_object(scm_c_make_gsubr(
+		"cog-slice-current?", 2, 0, 0, (scm_t_subr) ss_current_p));
+	sym_yield = scm_from_utf8_symbol("yield");
+	return nullptr;
+}
+
+SchemeSlicer::SchemeSlicer(size_t nthreads, unsigned slice_ms) :
+	_slice(slice_ms),
+	_stop(false)
+{
+	SchemeEval::init_scheme();
+	std::call_once(slicer_once, [] { scm_with_guile(init_slicer_scm, nullptr); });
+
+	for (size_t i = 0; i < nthreads; i++)
+	{
+		_workers.emplace_back(new Worker);
+		_workers.back()->thread = SCM_BOOL_F;
+		_workers.back()->running = nullptr;
+		_workers.back()->slice = 0;
+		_workers.back()->started = 0;
+	}
+	for (auto& w : _workers)
+		_threads.emplace_back(&SchemeSlicer::worker_loop, this, w.get());
+	_ticker = std::thread(&SchemeSlicer::ticker_loop, this);
+}
+
+SchemeSlicer::~SchemeSlicer()
+{
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		_stop = true;
+	}
+	_run_cv.notify_all();
+	_tick_cv.notify_all();
+	for (auto& t : _threads) t.join();
+	_ticker.join();
+
+	// Suspended sessions are left in the run queue; drop their
+	// continuations and ports, and wake anyone polling on them.
+	scm_with_guile(c_wrap_release, this);
+	_done_cv.notify_all();
+}
+
+void* SchemeSlicer::c_wrap_release(void* p)
+{
+	SchemeSlicer* self = (SchemeSlicer*) p;
+	std::lock_guard<std::mutex> lck(self->_mtx);
+	for (const SessionPtr& sess : self->_runq)
+	{
+		if (scm_is_true(sess->cont))
+			scm_gc_unprotect_object(sess->cont);
+		sess->cont = SCM_BOOL_F;
+		if (scm_is_true(sess->port))
+		{
+			scm_close_port(sess->port);
+			scm_gc_unprotect_object(sess->port);
+		}
+		sess->port = SCM_BOOL_F;
+		sess->result = "ABORT: slicer shut down\n";
+		sess->done = true;
+	}
+	self->_runq.clear();
+	return self;
+}
+
+SchemeSlicer::SessionPtr SchemeSlicer::open_session(AtomSpace* as)
+{
+	SessionPtr sess(std::make_shared<Session>());
+	sess->atomspace = as;
+	sess->port = SCM_BOOL_F;
+	sess->cont = SCM_BOOL_F;
+	sess->busy = false;
+	sess->done = false;
+	return sess;
+}
+
+void SchemeSlicer::submit(const SessionPtr& sess, const std::string& expr)
+{
+	std::lock_guard<std::mutex> lck(_mtx);
+	if (sess->busy)
+		throw RuntimeException(TRACE_INFO,
+			"Session is still evaluating a previous expression");
+	sess->busy = true;
+	sess->done = false;
+	sess->expr = expr;
+	sess->result.clear();
+	_runq.push_back(sess);
+	_run_cv.notify_one();
+}
+
+std::string SchemeSlicer::poll(const SessionPtr& sess)
+{
+	std::unique_lock<std::mutex> lck(_mtx);
+	while (sess->busy and not sess->done)
+		_done_cv.wait(lck);
+
+	std::string rv;
+	std::swap(rv, sess->result);
+	sess->busy = false;
+	sess->done = false;
+	return rv;
+}
+
+/// Run one time slice of the session. This must be called in guile
+/// mode, from a worker thread.
+void SchemeSlicer::run_slice(const SessionPtr& sess)
+{
+	AtomSpace* saved_as = nullptr;
+	if (sess->atomspace)
+	{
+		saved_as = SchemeSmob::ss_get_env_as("slicer");
+		SchemeSmob::ss_set_env_as(sess->atomspace);
+	}
+
+	SCM rc;
+	if (scm_is_false(sess->cont))
+	{
+		// utf8_to_scm() does not throw; malformed input is reported
+		// the way a caught error would be, and not evaluated.
+		std::string badmsg;
+		SCM expr_str = SchemeEval::utf8_to_scm(sess->expr, badmsg);
+		if (scm_is_false(expr_str))
+		{
+			if (saved_as)
+				SchemeSmob::ss_set_env_as(saved_as);
+			std::lock_guard<std::mutex> lck(_mtx);
+			sess->result = badmsg + "\nABORT: decoding-error\n";
+			sess->done = true;
+			_done_cv.notify_all();
+			return;
+		}
+		sess->port = scm_gc_protect_object(scm_open_output_string());
+		rc = scm_call_2(slice_run, expr_str, sess->port);
+	}
+	else
+	{
+		SCM k = sess->cont;
+		sess->cont = SCM_BOOL_F;
+		rc = scm_call_1(slice_resume, k);
+		scm_gc_unprotect_object(k);
+	}
+
+	if (saved_as)
+		SchemeSmob::ss_set_env_as(saved_as);
+
+	if (scm_is_eq(SCM_CAR(rc), sym_yield))
+	{
+		sess->cont = scm_gc_protect_object(SCM_CDR(rc));
+		std::lock_guard<std::mutex> lck(_mtx);
+		_runq.push_back(sess);
+		_run_cv.notify_one();
+		return;
+	}
+
+	char* str = scm_to_utf8_stringn(SCM_CDR(rc), nullptr);
+	scm_close_port(sess->port);
+	scm_gc_unprotect_object(sess->port);
+	sess->port = SCM_BOOL_F;
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	sess->result = str;
+	free(str);
+	sess->done = true;
+	_done_cv.notify_all();
+}
+
+void SchemeSlicer::worker_loop(Worker* w)
+{
+	set_thread_name("atoms:slicer");
+	std::pair<SchemeSlicer*, Worker*> args(this, w);
+	scm_with_guile(c_wrap_worker, &args);
+}
+
+void* SchemeSlicer::c_wrap_worker(void* p)
+{
+	auto args = (std::pair<SchemeSlicer*, Worker*>*) p;
+	SchemeSlicer* self = args->first;
+	Worker* w = args->second;
+	w->thread = scm_current_thread();
+
+	while (true)
+	{
+		SessionPtr sess;
+		{
+			std::unique_lock<std::mutex> lck(self->_mtx);
+			while (self->_runq.empty() and not self->_stop)
+				self->_run_cv.wait(lck);
+			if (self->_stop) break;
+			sess = self->_runq.front();
+			self->_runq.pop_front();
+		}
+
+		w->started = std::chrono::steady_clock::now().time_since_epoch().count();
+		w->slice++;
+		w->running = sess.get();
+		self->run_slice(sess);
+		w->running = nullptr;
+	}
+	return p;
+}
+
+void SchemeSlicer::ticker_loop(void)
+{
+	set_thread_name("atoms:slicetick");
+	scm_with_guile(c_wrap_ticker, this);
+}
+
+/// Preempt any worker that has used up its time slice, but only if
+/// there is some other session waiting to run.
+void* SchemeSlicer::c_wrap_ticker(void* p)
+{
+	SchemeSlicer* self = (SchemeSlicer*) p;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lck(self->_mtx);
+			if (self->_tick_cv.wait_for(lck, self->_slice,
+			                           [self] { return self->_stop; }))
+				break;
+			if (self->_runq.empty()) continue;
+		}
+
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		auto slice = std::chrono::duration_cast<
+			std::chrono::steady_clock::duration>(self->_slice).count();
+		for (auto& w : self->_workers)
+		{
+			if (nullptr == w->running.load()) continue;
+			uint64_t serial = w->slice.load();
+			if (now.count() - w->started.load() < slice) continue;
+			SCM yield = scm_call_3(slice_make_yield, slice_current_p,
+				scm_from_pointer(w.get(), nullptr), scm_from_uint64(serial));
+			scm_system_async_mark_for_thread(yield, w->thread);
+		}
+	}
+	return p;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,128 @@
+/*
+ * SchemeSlicer.h
+ *
+ * Cooperative time-slicing of many scheme sessions over a few threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_SLICER_H
+#define _OPENCOG_SCHEME_SLICER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <libguile.h>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+class AtomSpace;
+
+/**
+ * Run the evaluations of many shell-like sessions on a small, fixed
+ * pool of threads, instead of dedicating a thread to each session.
+ *
+ * Each expression is evaluated inside a guile prompt. A ticker thread
+ * marks a system async on any worker whose current evaluation has run
+ * longer than one time slice; at its next safe point, the evaluation
+ * aborts to the prompt, its continuation is saved, and the session
+ * goes to the back of the run queue. Another worker later resumes it
+ * from where it left off. Idle sessions hold no thread at all.
+ *
+ * Only pure scheme code can be suspended: if there is a C frame
+ * between the prompt and the safe point (for example, scheme called
+ * from a GroundedSchemaNode, inside cog-execute!), then the slice
+ * simply runs on until it reaches a suspendable point. This requires
+ * guile-2.2 or later.
+ *
+ * Results are rendered the way the shell does: captured output,
+ * followed by the printed value, or by the error report.
+ */
+class SchemeSlicer
+{
+	public:
+		struct Session
+		{
+			AtomSpace* atomspace;
+			std::string expr;
+			std::string result;
+			SCM port;
+			SCM cont;
+			bool busy;
+			bool done;
+		};
+		typedef std::shared_ptr<Session> SessionPtr;
+
+	private:
+		struct Worker
+		{
+			SCM thread;
+			std::atomic<Session*> running;
+			std::atomic<uint64_t> slice;   // Counts the slices run.
+			std::atomic<std::chrono::steady_clock::rep> started;
+		};
+
+		std::chrono::milliseconds _slice;
+		std::vector<std::thread> _threads;
+		std::vector<std::unique_ptr<Worker>> _workers;
+		std::thread _ticker;
+
+		std::mutex _mtx;
+		std::condition_variable _run_cv;
+		std::condition_variable _done_cv;
+		std::condition_variable _tick_cv;
+		std::deque<SessionPtr> _runq;
+		bool _stop;
+
+		void run_slice(const SessionPtr&);
+		void worker_loop(Worker*);
+		void ticker_loop(void);
+		static void* c_wrap_worker(void*);
+		static void* c_wrap_ticker(void*);
+		static void* c_wrap_release(void*);
+		static void* init_slicer_scm(void*);
+		static SCM ss_current_p(SCM, SCM);
+
+	public:
+		SchemeSlicer(size_t nthreads, unsigned slice_ms = 10);
+		~SchemeSlicer();
+
+		SessionPtr open_session(AtomSpace* as = nullptr);
+
+		/// Queue an expression for evaluation. Only one expression may
+		/// be in flight per session; throws if the session is busy.
+		void submit(const SessionPtr&, const std::string& expr);
+
+		/// Block until the session's expression is done; return what
+		/// the shell would print for it.
+		std::string poll(const SessionPtr&);
+};
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_SLICER_H
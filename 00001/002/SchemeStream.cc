@@ -0,0 +1,145 @@
+/*
+ * SchemeStream.cc
+ *
+ * Lazy, chunked iteration over the result of a scheme evaluation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/exceptions.h>
+
+#include "SchemeEval.h"
+#include "SchemeSmob.h"
+#include "SchemeStream.h"
+
+using namespace opencog;
+
+/// This must be called in guile mode.
+SchemeStream::SchemeStream(SchemeEval* ev, SCM src) :
+	_evaluator(ev),
+	_source(SCM_EOL),
+	_is_generator(false),
+	_done(false),
+	_chunk_size(512)
+{
+	if (scm_is_true(scm_procedure_p(src)))
+		_is_generator = true;
+	else if (scm_is_false(scm_list_p(src)))
+		src = scm_list_1(src);
+
+	_source = scm_gc_protect_object(src);
+}
+
+SchemeStream::~SchemeStream()
+{
+	scm_with_guile(c_wrap_release, this);
+}
+
+void* SchemeStream::c_wrap_release(void* p)
+{
+	SchemeStream* self = (SchemeStream*) p;
+	scm_gc_unprotect_object(self->_source);
+	self->_source = SCM_EOL;
+	return self;
+}
+
+void* SchemeStream::c_wrap_fill(void* p)
+{
+	SchemeStream* self = (SchemeStream*) p;
+	self->fill();
+	return self;
+}
+
+// Call the generator up to n times, collecting the results in a list.
+// Stop early at the end-of-file object, which is kept as the last
+// element, so that the caller knows that the generator is done.
+static SCM pull_generator(void* p)
+{
+	SCM args = (SCM) p;
+	SCM gen = SCM_CAR(args);
+	size_t n = scm_to_size_t(SCM_CDR(args));
+
+	SCM rv = SCM_EOL;
+	for (size_t i = 0; i < n; i++)
+	{
+		SCM item = scm_call_0(gen);
+		rv = scm_cons(item, rv);
+		if (SCM_EOF_OBJECT_P(item)) break;
+	}
+	return scm_reverse_x(rv, SCM_EOL);
+}
+
+/// Convert the next chunk of elements. This must be called in
+/// guile mode.
+void SchemeStream::fill(void)
+{
+	SCM items = _source;
+	if (_is_generator)
+	{
+		SCM args = scm_cons(_source, scm_from_size_t(_chunk_size));
+		items = _evaluator->do_scm_eval(args, pull_generator, _source);
+		if (_evaluator->eval_error())
+		{
+			_error_msg = _evaluator->_error_msg;
+			_done = true;
+			return;
+		}
+	}
+
+	size_t n = 0;
+	while (scm_is_pair(items) and n < _chunk_size)
+	{
+		SCM item = SCM_CAR(items);
+		items = SCM_CDR(items);
+		if (SCM_EOF_OBJECT_P(item) and _is_generator)
+		{
+			_done = true;
+			return;
+		}
+		_chunk.push_back(SchemeSmob::scm_to_protom(item));
+		n++;
+	}
+
+	if (_is_generator) return;
+
+	// Protect the remainder before letting go of what was consumed,
+	// so that the head of the list can be collected.
+	SCM consumed = _source;
+	_source = scm_gc_protect_object(items);
+	scm_gc_unprotect_object(consumed);
+	if (not scm_is_pair(items)) _done = true;
+}
+
+bool SchemeStream::next(ValuePtr& vp)
+{
+	if (_chunk.empty() and not _done)
+		scm_with_guile(c_wrap_fill, this);
+
+	if (not _error_msg.empty())
+	{
+		std::string msg;
+		std::swap(msg, _error_msg);
+		throw RuntimeException(TRACE_INFO, "%s", msg.c_str());
+	}
+
+	if (_chunk.empty()) return false;
+
+	vp = std::move(_chunk.front());
+	_chunk.pop_front();
+	return true;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,122 @@
+/*
+ * SchemeStream.h
+ *
+ * Lazy, chunked iteration over the result of a scheme evaluation.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_STREAM_H
+#define _OPENCOG_SCHEME_STREAM_H
+
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <string>
+
+#include <libguile.h>
+#include <opencog/atoms/value/Value.h>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+class SchemeEval;
+
+/**
+ * Iterate over the result of SchemeEval::eval_stream(), without
+ * converting all of it to C++ at once.
+ *
+ * If the expression evaluated to a list, the elements of the list are
+ * converted a chunk at a time. If it evaluated to a procedure, that
+ * procedure is taken to be a generator: it is called repeatedly, and
+ * each call yields one element, until it returns the end-of-file
+ * object (the SRFI-158 convention). Anything else is a stream holding
+ * exactly one element.
+ *
+ * The not-yet-consumed remainder stays protected from the garbage
+ * collector until the stream is exhausted or destroyed; the consumer
+ * may stop at any time. Streams are used from the thread that created
+ * them, just like the evaluator that created them.
+ */
+class SchemeStream
+{
+	friend class SchemeEval;
+	private:
+		SchemeEval* _evaluator;
+		SCM _source;
+		bool _is_generator;
+		bool _done;
+		size_t _chunk_size;
+		std::deque<ValuePtr> _chunk;
+		std::string _error_msg;
+
+		void fill(void);
+		static void* c_wrap_fill(void*);
+		static void* c_wrap_release(void*);
+
+	public:
+		SchemeStream(SchemeEval*, SCM);
+		~SchemeStream();
+		SchemeStream(const SchemeStream&) = delete;
+		SchemeStream& operator=(const SchemeStream&) = delete;
+
+		/// Number of elements to convert per entry into guile.
+		void set_chunk_size(size_t n) { _chunk_size = (0 < n) ? n : 1; }
+
+		/// Fetch the next element. Returns false when there are no
+		/// more. The element may be null, if the scheme object was not
+		/// an atom or value. Throws if the generator threw an error.
+		bool next(ValuePtr&);
+
+		class iterator
+		{
+			private:
+				SchemeStream* _strm;
+				ValuePtr _cur;
+				void advance(void)
+				{
+					if (_strm and not _strm->next(_cur)) _strm = nullptr;
+				}
+			public:
+				typedef std::input_iterator_tag iterator_category;
+				typedef ValuePtr value_type;
+				typedef std::ptrdiff_t difference_type;
+				typedef const ValuePtr* pointer;
+				typedef const ValuePtr& reference;
+
+				iterator(SchemeStream* s) : _strm(s) { advance(); }
+				reference operator*() const { return _cur; }
+				pointer operator->() const { return &_cur; }
+				iterator& operator++() { advance(); return *this; }
+				bool operator==(const iterator& o) const
+					{ return _strm == o._strm; }
+				bool operator!=(const iterator& o) const
+					{ return _strm != o._strm; }
+		};
+
+		iterator begin(void) { return iterator(this); }
+		iterator end(void) { return iterator(nullptr); }
+};
+
+typedef std::shared_ptr<SchemeStream> SchemeStreamPtr;
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_STREAM_H
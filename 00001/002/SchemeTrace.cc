@@ -0,0 +1,252 @@
+/*
+ * SchemeTrace.cc
+ *
+ * Span tracing of scheme evaluation, in the Chrome trace format.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <opencog/util/Logger.h>
+
+#include "SchemeTrace.h"
+
+using namespace opencog;
+
+// Keep memory bounded, if tracing is left on; events past this many
+// are counted, but not kept.
+#define TRACE_MAX_EVENTS (1<<20)
+
+// Details (e.g. the expression being evaluated) are cut short, to at
+// most this many bytes.
+#define TRACE_MAX_DETAIL 120
+
+struct TraceEvent
+{
+	const char* name;
+	char phase;
+	int tid;
+	int64_t ts;
+	int64_t dur;
+	std::string detail;
+};
+
+// Each thread records into a buffer of its own, so that threads don't
+// contend for one lock on every event. The buffer's lock is taken only
+// by its own thread, except when stop() collects the events. A thread
+// that exits hands its events over to trace_orphans.
+struct TraceBuffer
+{
+	std::mutex mtx;
+	std::vector<TraceEvent> events;
+
+	TraceBuffer();
+	~TraceBuffer();
+};
+
+std::atomic<bool> SchemeTrace::_enabled(false);
+
+// trace_mtx guards the list of buffers, the orphans and the path.
+static std::mutex trace_mtx;
+static std::string trace_path;
+static std::vector<TraceBuffer*> trace_buffers;
+static std::vector<TraceEvent> trace_orphans;
+static std::atomic<size_t> trace_count(0);
+static std::atomic<size_t> trace_dropped(0);
+static bool trace_atexit = false;
+
+TraceBuffer::TraceBuffer()
+{
+	std::lock_guard<std::mutex> lck(trace_mtx);
+	trace_buffers.push_back(this);
+}
+
+TraceBuffer::~TraceBuffer()
+{
+	std::lock_guard<std::mutex> lck(trace_mtx);
+	std::lock_guard<std::mutex> blck(mtx);
+	for (TraceEvent& ev : events)
+		trace_orphans.emplace_back(std::move(ev));
+	trace_buffers.erase(
+		std::find(trace_buffers.begin(), trace_buffers.end(), this));
+}
+
+static thread_local TraceBuffer trace_buffer;
+
+static thread_local int trace_tid = 0;
+
+static inline int current_tid(void)
+{
+	if (0 == trace_tid) trace_tid = gettid();
+	return trace_tid;
+}
+
+int64_t SchemeTrace::now_usec(void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Cut the detail short, but not in the middle of a UTF-8 sequence;
+/// the trace viewers reject the whole file if it is not valid UTF-8.
+static std::string_view clip_detail(std::string_view detail)
+{
+	if (detail.size() <= TRACE_MAX_DETAIL) return detail;
+	size_t n = TRACE_MAX_DETAIL;
+	while (0 < n and 0x80 == (detail[n] & 0xc0)) n--;
+	return detail.substr(0, n);
+}
+
+SchemeTrace::Span::Span(const char* name, std::string_view detail) :
+	_name(name), _start(-1)
+{
+	if (not enabled()) return;
+	_detail = clip_detail(detail);
+	_start = now_usec();
+}
+
+static void record(TraceEvent&& ev)
+{
+	if (TRACE_MAX_EVENTS <= trace_count.fetch_add(1))
+	{
+		trace_dropped++;
+		return;
+	}
+	TraceBuffer& tb = trace_buffer;
+	std::lock_guard<std::mutex> lck(tb.mtx);
+	tb.events.emplace_back(std::move(ev));
+}
+
+void SchemeTrace::complete(const char* name, int64_t start_usec,
+                           int64_t dur_usec, std::string_view detail)
+{
+	if (not enabled()) return;
+	record({name, 'X', current_tid(), start_usec, dur_usec,
+		std::string(clip_detail(detail))});
+}
+
+void SchemeTrace::instant(const char* name, std::string_view detail)
+{
+	if (not enabled()) return;
+	record({name, 'i', current_tid(), now_usec(), 0,
+		std::string(clip_detail(detail))});
+}
+
+static void write_json_string(FILE* fp, const std::string& str)
+{
+	fputc('"', fp);
+	for (unsigned char c : str)
+	{
+		if ('"' == c or '\\' == c) fprintf(fp, "\\%c", c);
+		else if (c < 0x20) fprintf(fp, "\\u%04x", c);
+		else fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+static void stop_at_exit(void)
+{
+	SchemeTrace::stop();
+}
+
+void SchemeTrace::start(const std::string& path)
+{
+	std::lock_guard<std::mutex> lck(trace_mtx);
+	trace_path = path;
+	trace_orphans.clear();
+	for (TraceBuffer* tb : trace_buffers)
+	{
+		std::lock_guard<std::mutex> blck(tb->mtx);
+		tb->events.clear();
+	}
+	trace_count = 0;
+	trace_dropped = 0;
+	if (not trace_atexit)
+	{
+		trace_atexit = true;
+		atexit(stop_at_exit);
+	}
+	_enabled = true;
+}
+
+void SchemeTrace::stop(void)
+{
+	_enabled = false;
+
+	std::lock_guard<std::mutex> lck(trace_mtx);
+	if (trace_path.empty()) return;
+
+	std::vector<TraceEvent> events(std::move(trace_orphans));
+	trace_orphans.clear();
+	for (TraceBuffer* tb : trace_buffers)
+	{
+		std::lock_guard<std::mutex> blck(tb->mtx);
+		for (TraceEvent& ev : tb->events)
+			events.emplace_back(std::move(ev));
+		tb->events.clear();
+		tb->events.shrink_to_fit();
+	}
+
+	// Each process writes a file of its own, so that forked workers
+	// don't overwrite each other's traces.
+	int pid = getpid();
+	std::string path = trace_path + "." + std::to_string(pid);
+	trace_path.clear();
+
+	FILE* fp = fopen(path.c_str(), "w");
+	if (nullptr == fp)
+	{
+		logger().warn("[SchemeTrace] Cannot write trace file %s\n",
+		              path.c_str());
+		return;
+	}
+
+	fprintf(fp, "{\"traceEvents\":[\n");
+	bool first = true;
+	for (const TraceEvent& ev : events)
+	{
+		if (not first) fprintf(fp, ",\n");
+		first = false;
+		fprintf(fp, "{\"name\":\"%s\",\"cat\":\"scheme\",\"ph\":\"%c\","
+		            "\"pid\":%d,\"tid\":%d,\"ts\":%lld",
+		        ev.name, ev.phase, pid, ev.tid, (long long) ev.ts);
+		if ('X' == ev.phase)
+			fprintf(fp, ",\"dur\":%lld", (long long) ev.dur);
+		else
+			fprintf(fp, ",\"s\":\"t\"");
+		if (not ev.detail.empty())
+		{
+			fprintf(fp, ",\"args\":{\"detail\":");
+			write_json_string(fp, ev.detail);
+			fputc('}', fp);
+		}
+		fputc('}', fp);
+	}
+	fprintf(fp, "\n],\"displayTimeUnit\":\"ms\","
+	            "\"otherData\":{\"dropped_events\":%zu}}\n",
+	        trace_dropped.load());
+	fclose(fp);
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,100 @@
+/*
+ * SchemeTrace.h
+ *
+ * Span tracing of scheme evaluation, in the Chrome trace format.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_TRACE_H
+#define _OPENCOG_SCHEME_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+/**
+ * Opt-in tracing of the stages of scheme evaluation: entry into guile,
+ * per-thread init, the atomspace switch, the catch body, garbage
+ * collection, output draining, and printing of results. The trace is
+ * written as Chrome trace-event JSON, which both chrome://tracing and
+ * ui.perfetto.dev can load.
+ *
+ * Tracing is off by default; then, a Span costs one atomic load.
+ * Turn it on with start(), or by setting COG_SCHEME_TRACE to the
+ * name of the file to write; the process id is appended to the name,
+ * so that each process writes its own file. The file is written by
+ * stop(), or at exit. Event names must be string literals; they are
+ * not copied. Each thread records into a buffer of its own.
+ */
+class SchemeTrace
+{
+	private:
+		static std::atomic<bool> _enabled;
+
+	public:
+		/// A span runs from its construction to its destruction.
+		class Span
+		{
+			private:
+				const char* _name;
+				std::string _detail;
+				int64_t _start;
+
+			public:
+				Span(const char* name) : _name(name), _start(-1)
+				{
+					if (enabled()) _start = now_usec();
+				}
+				Span(const char* name, std::string_view detail);
+				~Span()
+				{
+					if (0 <= _start)
+						complete(_name, _start, now_usec() - _start, _detail);
+				}
+		};
+
+		static bool enabled(void)
+		{
+			return _enabled.load(std::memory_order_relaxed);
+		}
+		static int64_t now_usec(void);
+
+		/// Start collecting events, to be written to the file.
+		static void start(const std::string& path);
+
+		/// Stop collecting events, and write the file.
+		static void stop(void);
+
+		/// Record a span that has already ended.
+		static void complete(const char* name, int64_t start_usec,
+		                     int64_t dur_usec, std::string_view detail = {});
+
+		/// Record a point in time.
+		static void instant(const char* name, std::string_view detail = {});
+};
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_TRACE_H
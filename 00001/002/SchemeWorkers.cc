@@ -0,0 +1,359 @@
+/*
+ * SchemeWorkers.cc
+ *
+ * Forked scheme evaluator worker processes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/Logger.h>
+
+#include "SchemeEval.h"
+#include "SchemeWorkers.h"
+
+using namespace opencog;
+
+SchemeWorkers::SchemeWorkers(const std::string& sockpath,
+                             size_t nworkers, AtomSpace* as,
+                             const std::string& warmup) :
+	_sockpath(sockpath),
+	_nworkers(nworkers),
+	_atomspace(as),
+	_warmup(warmup),
+	_listen_fd(-1),
+	_running(false),
+	_zygote(-1)
+{
+}
+
+SchemeWorkers::~SchemeWorkers()
+{
+	stop();
+}
+
+// Read or write exactly len bytes; false on EOF or error.
+static bool read_all(int fd, void* buf, size_t len)
+{
+	char* p = (char*) buf;
+	while (0 < len)
+	{
+		ssize_t nr = read(fd, p, len);
+		if (nr < 0 and EINTR == errno) continue;
+		if (nr <= 0) return false;
+		p += nr;
+		len -= nr;
+	}
+	return true;
+}
+
+static bool write_all(int fd, const void* buf, size_t len)
+{
+	const char* p = (const char*) buf;
+	while (0 < len)
+	{
+		ssize_t nw = write(fd, p, len);
+		if (nw < 0 and EINTR == errno) continue;
+		if (nw <= 0) return false;
+		p += nw;
+		len -= nw;
+	}
+	return true;
+}
+
+static bool read_msg(int fd, std::string& msg)
+{
+	uint32_t len;
+	if (not read_all(fd, &len, sizeof(len))) return false;
+	msg.resize(len);
+	return read_all(fd, &msg[0], len);
+}
+
+static bool write_msg(int fd, const std::string& msg)
+{
+	uint32_t len = msg.size();
+	return write_all(fd, &len, sizeof(len)) and
+	       write_all(fd, msg.data(), len);
+}
+
+// The number of threads in this process; zero if it can't be told.
+static int thread_count(void)
+{
+	FILE* fp = fopen("/proc/self/status", "r");
+	if (nullptr == fp) return 0;
+
+	int n = 0;
+	char line[128];
+	while (fgets(line, sizeof(line), fp))
+		if (1 == sscanf(line, "Threads: %d", &n)) break;
+	fclose(fp);
+	return n;
+}
+
+void SchemeWorkers::start(void)
+{
+	// Everything below relies on fork() being safe, which it is only
+	// in a single-threaded process.
+	if (1 < thread_count())
+		throw RuntimeException(TRACE_INFO,
+			"SchemeWorkers must be started before guile is initialized, "
+			"and before any other thread is started");
+
+	_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (_listen_fd < 0)
+		throw RuntimeException(TRACE_INFO, "socket: %s", strerror(errno));
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, _sockpath.c_str(), sizeof(addr.sun_path) - 1);
+	unlink(_sockpath.c_str());
+
+	if (bind(_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) < 0 or
+	    listen(_listen_fd, 128) < 0)
+		throw RuntimeException(TRACE_INFO, "Cannot listen on %s: %s",
+			_sockpath.c_str(), strerror(errno));
+
+	_running = true;
+	pid_t pid = fork();
+	if (0 == pid)
+	{
+		zygote_main();
+		_exit(0);
+	}
+	if (pid < 0)
+	{
+		_running = false;
+		throw RuntimeException(TRACE_INFO, "fork: %s", strerror(errno));
+	}
+
+	// The zygote and the workers get a process group of their own, so
+	// that stop() can signal all of them at once. This is done on both
+	// sides of the fork, so that it is in effect whichever runs first.
+	setpgid(pid, pid);
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		_zygote = pid;
+	}
+
+	logger().info("[SchemeWorkers] %zu workers serving %s",
+	              _nworkers, _sockpath.c_str());
+}
+
+static volatile sig_atomic_t zygote_stopping = 0;
+
+static void zygote_sigterm(int)
+{
+	zygote_stopping = 1;
+}
+
+/// The zygote forks the workers, and re-forks those that die. It must
+/// stay single-threaded, so that it is always safe for it to fork: it
+/// never enters guile, and it does not log (the logger may start a
+/// thread); it reports to stderr instead. The workers are only ever
+/// touched here, by the zygote's one thread, so `_pids` needs no lock.
+void SchemeWorkers::zygote_main(void)
+{
+	setpgid(0, 0);
+
+	// Die along with the supervisor.
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+	// No SA_RESTART, so that SIGTERM breaks out of waitpid().
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = zygote_sigterm;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGTERM, &sa, nullptr);
+
+	for (size_t i = 0; i < _nworkers; i++)
+		_pids.push_back(spawn());
+
+	while (not zygote_stopping)
+	{
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0)
+		{
+			if (EINTR == errno) continue;
+			break;
+		}
+
+		auto it = std::find(_pids.begin(), _pids.end(), pid);
+		if (_pids.end() == it or zygote_stopping) continue;
+
+		fprintf(stderr, "[SchemeWorkers] worker %d exited (status %d); "
+		        "restarting\n", pid, status);
+		*it = spawn();
+	}
+
+	for (pid_t pid : _pids)
+		if (0 < pid) kill(pid, SIGTERM);
+	while (0 < waitpid(-1, nullptr, 0) or EINTR == errno) {}
+}
+
+/// Fork one worker, from the zygote. If the fork fails, keep trying,
+/// once a second, unless told to stop.
+pid_t SchemeWorkers::spawn(void)
+{
+	while (not zygote_stopping)
+	{
+		pid_t pid = fork();
+		if (0 == pid)
+		{
+			signal(SIGTERM, SIG_DFL);
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+			worker_main();
+			_exit(0);
+		}
+		if (0 < pid) return pid;
+
+		fprintf(stderr, "[SchemeWorkers] fork: %s\n", strerror(errno));
+		sleep(1);
+	}
+	return -1;
+}
+
+/// A worker is a fresh, single-threaded process; it boots guile for
+/// itself, warms up, and then serves requests until it is killed.
+void SchemeWorkers::worker_main(void)
+{
+	signal(SIGPIPE, SIG_IGN);
+	auto start = std::chrono::steady_clock::now();
+	SchemeEval::init_scheme();
+	SchemeEval* evaluator = SchemeEval::get_evaluator(_atomspace);
+
+	if (not _warmup.empty())
+	{
+		std::string rs = evaluator->eval(_warmup);
+		if (evaluator->eval_error())
+			logger().warn("[SchemeWorkers] warm-up failed: %s", rs.c_str());
+	}
+	logger().info("[SchemeWorkers] worker %d ready after %ld usecs",
+		getpid(), (long) std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count());
+
+	while (true)
+	{
+		int fd = accept(_listen_fd, nullptr, nullptr);
+		if (fd < 0)
+		{
+			if (EINTR == errno) continue;
+			logger().error("[SchemeWorkers] accept: %s", strerror(errno));
+			return;
+		}
+
+		std::string expr;
+		while (read_msg(fd, expr))
+		{
+			std::vector<std::string> batch{expr};
+			std::string result;
+			std::vector<size_t> offsets;
+			evaluator->eval_many(batch, result, offsets);
+			if (not write_msg(fd, result)) break;
+		}
+		close(fd);
+	}
+}
+
+/// The zygote cannot be re-forked once the supervisor has started
+/// other threads, so if it dies, supervision ends.
+void SchemeWorkers::supervise(void)
+{
+	pid_t zygote;
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		zygote = _zygote;
+	}
+	if (zygote <= 0) return;
+
+	int status = 0;
+	while (_running)
+	{
+		pid_t pid = waitpid(zygote, &status, 0);
+		if (pid < 0 and EINTR == errno) continue;
+		break;
+	}
+
+	std::lock_guard<std::mutex> lck(_mtx);
+	if (_running and _zygote == zygote)
+	{
+		logger().error("[SchemeWorkers] zygote %d exited (status %d); "
+		               "workers are no longer supervised", zygote, status);
+		_zygote = -1;
+	}
+}
+
+void SchemeWorkers::stop(void)
+{
+	if (not _running.exchange(false)) return;
+
+	pid_t zygote;
+	{
+		std::lock_guard<std::mutex> lck(_mtx);
+		zygote = _zygote;
+		_zygote = -1;
+	}
+	if (0 < zygote)
+	{
+		kill(-zygote, SIGTERM);
+		waitpid(zygote, nullptr, 0);
+	}
+
+	close(_listen_fd);
+	_listen_fd = -1;
+	unlink(_sockpath.c_str());
+}
+
+std::string SchemeWorkers::eval(const std::string& sockpath,
+                                const std::string& expr)
+{
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		throw RuntimeException(TRACE_INFO, "socket: %s", strerror(errno));
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, sockpath.c_str(), sizeof(addr.sun_path) - 1);
+
+	std::string result;
+	bool ok = 0 == connect(fd, (struct sockaddr*) &addr, sizeof(addr))
+		and write_msg(fd, expr) and read_msg(fd, result);
+	int err = errno;
+	close(fd);
+
+	if (not ok)
+		throw RuntimeException(TRACE_INFO, "Eval via %s failed: %s",
+			sockpath.c_str(), strerror(err));
+	return result;
+}
+
+/* ===================== END OF FILE ============================ */
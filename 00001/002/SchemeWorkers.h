@@ -0,0 +1,124 @@
+/*
+ * SchemeWorkers.h
+ *
+ * Forked scheme evaluator worker processes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_SCHEME_WORKERS_H
+#define _OPENCOG_SCHEME_WORKERS_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace opencog
+{
+/** \addtogroup grp_smob
+ *  @{
+ */
+
+class AtomSpace;
+
+/**
+ * Process supervisor for scheme evaluation.
+ *
+ * A number of worker processes, each with its own guile and its own
+ * garbage collector, so GC pauses in one do not stall the others, and
+ * there is no lock contention between them. Workers that die are
+ * re-forked.
+ *
+ * It is not safe to fork() a process that is running guile: the
+ * child gets only the forking thread, while locks held by the other
+ * threads (guile's, bdwgc's, and our own) stay locked forever, and
+ * the finalizer, logging and pipeline threads are gone. Nor can a
+ * process that has booted guile be brought back to a single thread:
+ * guile boots on the immortal thread (see SchemeEval::prewarm()),
+ * which never exits. So workers are not forked from a warmed guile.
+ * Instead, start() must be called while the process is still
+ * single-threaded, before guile is initialized. It forks a zygote: a
+ * small process that never runs guile, and never starts a thread.
+ * The zygote forks the workers (and re-forks them when they die);
+ * each worker then boots guile for itself, evaluates the warm-up
+ * expression, if any, and only then starts taking requests. An
+ * AtomSpace filled in before start() is inherited by the workers
+ * copy-on-write; guile is not, so each worker start, or restart,
+ * costs one guile boot plus the warm-up. SchemeWorkersBM measures
+ * that cost, as the time until the first reply.
+ *
+ * All workers accept() on one shared unix-domain socket; the kernel
+ * spreads connections across them. The wire format is a 4-byte
+ * length, in host byte order, followed by that many bytes of UTF-8,
+ * in both directions. Each request is a scheme expression; the reply
+ * is exactly what the shell would print for it (see eval_expr()).
+ *
+ * Note that every worker has its own private copy of the AtomSpace.
+ * Changes made in one worker are not seen by the others. This mode is
+ * meant for read-mostly query serving.
+ */
+class SchemeWorkers
+{
+	private:
+		std::string _sockpath;
+		size_t _nworkers;
+		AtomSpace* _atomspace;
+		std::string _warmup;
+		int _listen_fd;
+		std::atomic<bool> _running;
+
+		// The zygote, as seen from the supervisor.
+		std::mutex _mtx;
+		pid_t _zygote;
+
+		// The workers, as seen from the zygote.
+		std::vector<pid_t> _pids;
+
+		void zygote_main(void);
+		pid_t spawn(void);
+		void worker_main(void);
+
+	public:
+		/// The warm-up expression is evaluated by each worker, after
+		/// booting guile and before accepting any request; use it to
+		/// load the modules that requests will need.
+		SchemeWorkers(const std::string& sockpath, size_t nworkers,
+		              AtomSpace* as = nullptr,
+		              const std::string& warmup = "");
+		~SchemeWorkers();
+
+		/// Bind the socket, fork the zygote, and have it fork the
+		/// workers. Throws if the process already has more than one
+		/// thread.
+		void start(void);
+
+		/// Block until stop(), or until the zygote dies.
+		void supervise(void);
+
+		/// Terminate all of the workers.
+		void stop(void);
+
+		/// Client side: send one expression, return the reply.
+		static std::string eval(const std::string& sockpath,
+		                        const std::string& expr);
+};
+
+/** @}*/
+}
+
+#endif // _OPENCOG_SCHEME_WORKERS_H
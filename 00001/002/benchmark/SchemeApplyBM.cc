@@ -0,0 +1,93 @@
+/*
+ * SchemeApplyBM.cc
+ *
+ * Cost of applying a scheme predicate to many groundings: one
+ * apply_v() per grounding, apply_v_batch(), and a vectorized
+ * apply_v_batch().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeApplyBM [N [REPS]]
+ *
+ * Applies a predicate to N (default 10000) groundings, REPS times
+ * (default 1000) each way. Printed: the time per round, each way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+#include <opencog/atoms/atom_types/atom_types.h>
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* what, double usecs, size_t reps)
+{
+	printf("%-16s %12.3f us/round\n", what, usecs / reps);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = (1 < argc) ? atol(argv[1]) : 10000;
+	size_t reps = (2 < argc) ? atol(argv[2]) : 1000;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+	ev->eval("(use-modules (opencog))");
+	ev->eval(
+		"(define (bm-pred x) (if (string-prefix? \"a\" (cog-name x))"
+		"  (stv 1 1) (stv 0 1)))"
+		"(define (bm-pred-vec argv)"
+		"  (list->vector (map (lambda (args) (apply bm-pred args))"
+		"    (vector->list argv))))");
+
+	HandleSeq groundings;
+	for (size_t i = 0; i < n; i++)
+		groundings.push_back(as->add_link(LIST_LINK,
+			as->add_node(CONCEPT_NODE, (i%2 ? "a" : "b") + std::to_string(i))));
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t r = 0; r < reps; r++)
+		for (const Handle& g : groundings)
+			ev->apply_v("bm-pred", g);
+	report("apply_v loop", usecs_since(start), reps);
+
+	start = std::chrono::steady_clock::now();
+	for (size_t r = 0; r < reps; r++)
+		ev->apply_v_batch("bm-pred", groundings);
+	report("apply_v_batch", usecs_since(start), reps);
+
+	start = std::chrono::steady_clock::now();
+	for (size_t r = 0; r < reps; r++)
+		ev->apply_v_batch("bm-pred-vec", groundings, true);
+	report("vectorized", usecs_since(start), reps);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
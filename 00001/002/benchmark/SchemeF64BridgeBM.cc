@@ -0,0 +1,83 @@
+/*
+ * SchemeF64BridgeBM.cc
+ *
+ * Cost of moving a FloatValue into scheme and back: as a list of
+ * boxed flonums, against as an f64 bytevector.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeF64BridgeBM [N [REPS]]
+ *
+ * Makes a FloatValue of N doubles (default 100000), and REPS times
+ * (default 100) turns it into scheme data and back into a new
+ * FloatValue: with cog-value->list and FloatValue, and with
+ * cog-value->f64vector and cog-f64vector->value.
+ * Printed: the time per round trip, each way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* what, double usecs, size_t reps)
+{
+	printf("%-20s %12.3f us/round trip\n", what, usecs / reps);
+}
+
+static void run(SchemeEval* ev, const char* what, const char* expr,
+                size_t reps)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+		ev->eval_v(expr);
+	report(what, usecs_since(start), reps);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = (1 < argc) ? atol(argv[1]) : 100000;
+	size_t reps = (2 < argc) ? atol(argv[2]) : 100;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+	ev->eval("(use-modules (opencog))");
+	ev->eval("(define bm-src (cog-new-value 'FloatValue "
+		"(map exact->inexact (iota " + std::to_string(n) + "))))");
+
+	run(ev, "boxed list",
+		"(cog-new-value 'FloatValue (cog-value->list bm-src))", reps);
+	run(ev, "f64 bytevector",
+		"(cog-f64vector->value (cog-value->f64vector bm-src))", reps);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
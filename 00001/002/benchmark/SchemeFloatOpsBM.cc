@@ -0,0 +1,115 @@
+/*
+ * SchemeFloatOpsBM.cc
+ *
+ * The cog-float-* primitives, compared to the same arithmetic done
+ * with scheme lists and flonums.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeFloatOpsBM [N [REPS]]
+ *
+ * Makes two FloatValues of N doubles (default 100000), and the same
+ * numbers as two scheme lists, then times REPS (default 100) rounds
+ * of add, dot and max, each way. The per-call time and the speedup
+ * are printed. Whether the AVX2 kernels were compiled in is printed
+ * too, since that depends on the build flags (-mavx2 or -march).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static const char* setup =
+	"(define bm-n {N})"
+	"(define bm-la (map (lambda (i) (* i 0.5)) (iota bm-n)))"
+	"(define bm-lb (map (lambda (i) (- bm-n i 0.25)) (iota bm-n)))"
+	"(define bm-fa (FloatValue bm-la))"
+	"(define bm-fb (FloatValue bm-lb))";
+
+static const struct
+{
+	const char* name;
+	const char* vectorized;
+	const char* scalar;
+} cases[] = {
+	{ "add",
+	  "(cog-float-add bm-fa bm-fb)",
+	  "(map + bm-la bm-lb)" },
+	{ "dot",
+	  "(cog-float-dot bm-fa bm-fb)",
+	  "(fold (lambda (a b acc) (+ acc (* a b))) 0.0 bm-la bm-lb)" },
+	{ "max",
+	  "(cog-float-max bm-fa)",
+	  "(apply max bm-la)" },
+};
+
+static double time_expr(SchemeEval& ev, const std::string& expr,
+                        size_t reps)
+{
+	std::string loop = "(do ((i 0 (+ i 1))) ((= i " +
+		std::to_string(reps) + ")) " + expr + ")";
+	auto start = std::chrono::steady_clock::now();
+	ev.eval(loop);
+	double secs = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+	if (ev.eval_error())
+	{
+		fprintf(stderr, "Error evaluating %s\n", expr.c_str());
+		exit(1);
+	}
+	return secs / reps;
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = (1 < argc) ? atoi(argv[1]) : 100000;
+	size_t reps = (2 < argc) ? atoi(argv[2]) : 100;
+
+#if defined(__AVX2__)
+	printf("AVX2 kernels: yes\n");
+#else
+	printf("AVX2 kernels: no (scalar loops)\n");
+#endif
+
+	AtomSpacePtr as(createAtomSpace());
+	SchemeEval ev(as);
+
+	std::string init(setup);
+	init.replace(init.find("{N}"), 3, std::to_string(n));
+	ev.eval(init);
+
+	for (const auto& c : cases)
+	{
+		double vec = time_expr(ev, c.vectorized, reps);
+		double scl = time_expr(ev, c.scalar, reps);
+		printf("%-4s n=%zu: cog-float %10.1f us  scheme %10.1f us  "
+		       "speedup %.1fx\n", c.name, n, vec * 1e6, scl * 1e6,
+		       scl / vec);
+	}
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,87 @@
+/*
+ * SchemeGCStartupBM.cc
+ *
+ * A GC-heavy startup: many threads making evaluators, loading modules
+ * and building data at once; reports the collection timings.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeGCStartupBM [THREADS [ROUNDS]]
+ *
+ * Starts THREADS threads (default 16) together. Each makes its own
+ * evaluator, loads a few modules, and then evaluates an expression that
+ * builds and drops a list of 20000 small lists, ROUNDS times (default
+ * 50). Set COG_SCHEME_TRACE to also get the collections as trace events.
+ * Printed: the wall-clock time, and (cog-gc-histograms): per collection,
+ * the total time, the pause, and the time to safepoint; per thread
+ * stopped, when it was sent the signal, and when it stopped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+	int nthreads = (1 < argc) ? atoi(argv[1]) : 16;
+	int rounds = (2 < argc) ? atoi(argv[2]) : 50;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+	ev->eval("(use-modules (opencog))");
+
+	std::atomic<int> ready(0);
+	std::vector<std::thread> threads;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < nthreads; i++)
+		threads.emplace_back([&]() {
+			ready++;
+			while (ready < nthreads) std::this_thread::yield();
+
+			SchemeEval tev(as);
+			tev.eval("(use-modules (opencog) (srfi srfi-1) (ice-9 match))");
+			for (int r = 0; r < rounds; r++)
+				tev.eval("(length (map (lambda (i) (list i (number->string i)))"
+				         " (iota 20000)))");
+		});
+	for (std::thread& t : threads) t.join();
+	printf("%d threads, %d rounds: %.3f ms\n", nthreads, rounds,
+	       usecs_since(start) / 1000.0);
+
+	printf("%s", ev->eval("(display (cog-gc-histograms))").c_str());
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
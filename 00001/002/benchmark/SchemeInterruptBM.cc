@@ -0,0 +1,96 @@
+/*
+ * SchemeInterruptBM.cc
+ *
+ * Interrupt delivery latency: the time from interrupt() until the
+ * interrupted evaluation returns.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeInterruptBM [REPS [EXPR]]
+ *
+ * Starts EXPR (by default, a loop that never ends) on a thread of its
+ * own, waits 20 ms, and interrupts it; REPS times (default 20). Pass
+ * an EXPR that spends its time in C++, e.g. one calling a slow
+ * primitive, to see the watchdog escalate. Printed: the mean and the
+ * worst time until eval_expr() returned, and interrupt_stats().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static const char* default_expr = "(let loop ((i 0)) (loop (+ i 1)))";
+
+int main(int argc, char* argv[])
+{
+	size_t reps = (1 < argc) ? atol(argv[1]) : 20;
+	std::string expr = (2 < argc) ? argv[2] : default_expr;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval::init_scheme();
+
+	double total = 0.0;
+	double worst = 0.0;
+	for (size_t i = 0; i < reps; i++)
+	{
+		std::atomic<SchemeEval*> ev(nullptr);
+		std::atomic<bool> done(false);
+		std::chrono::steady_clock::time_point returned;
+		std::thread spin([&]() {
+			SchemeEval* sev = SchemeEval::get_evaluator(as);
+			sev->begin_eval();
+			ev = sev;
+			sev->eval_expr(expr);
+			returned = std::chrono::steady_clock::now();
+			done = true;
+			sev->poll_result();
+		});
+		while (nullptr == ev.load()) std::this_thread::yield();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+		// An interrupt that lands before the evaluation has started is
+		// dropped; so keep at it, timing from the first one.
+		auto sent = std::chrono::steady_clock::now();
+		while (not done)
+		{
+			ev.load()->interrupt();
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
+		spin.join();
+
+		double usecs = std::chrono::duration<double, std::micro>(
+			returned - sent).count();
+		total += usecs;
+		if (worst < usecs) worst = usecs;
+	}
+	printf("to return: %.3f us mean, %.3f us max\n", total / reps, worst);
+	printf("%s\n", SchemeEval::interrupt_stats().c_str());
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
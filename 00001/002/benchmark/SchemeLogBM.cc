@@ -0,0 +1,97 @@
+/*
+ * SchemeLogBM.cc
+ *
+ * Cost of logging evaluation output in the cogserver: every evaluation
+ * logged, against one in a hundred, for plain and prepared evaluations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeLogBM [REPS]
+ *
+ * Evaluates an expression that prints a line, REPS times (default
+ * 10000), with eval_v() and with a prepared procedure, first logging
+ * every evaluation and then one in a hundred.
+ * Printed: the time per evaluation, each way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+#include <opencog/guile/SchemePrepared.h>
+#include <opencog/util/Logger.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* what, double usecs, size_t reps)
+{
+	printf("%-20s %12.3f us/eval\n", what, usecs / reps);
+}
+
+static void run(SchemeEval* ev, SchemePreparedPtr& prep,
+                const char* expr, const char* how, size_t reps)
+{
+	char what[64];
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+		ev->eval_v(expr);
+	snprintf(what, sizeof(what), "eval_v, %s", how);
+	report(what, usecs_since(start), reps);
+
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+		prep->bind("log").exec();
+	snprintf(what, sizeof(what), "prepared, %s", how);
+	report(what, usecs_since(start), reps);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t reps = (1 < argc) ? atol(argv[1]) : 10000;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+
+	// Output is logged only at info level, and only once the output
+	// port has been captured, which any shell evaluation does.
+	logger().set_level(Logger::INFO);
+	ev->eval("(use-modules (opencog))");
+
+	const char* expr = "(begin (display \"some output\") (Concept \"log\"))";
+	SchemePreparedPtr prep = ev->prepare(
+		"(lambda (s) (display \"some output\") (Concept s))");
+
+	SchemeEval::set_output_logging(1, 1000000);
+	run(ev, prep, expr, "every", reps);
+
+	SchemeEval::set_output_logging(100, 1000000);
+	run(ev, prep, expr, "1 in 100", reps);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,74 @@
+/*
+ * SchemeMemoBM.cc
+ *
+ * Cost of a repeated, pure eval_v() query, with and without
+ * memoization.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeMemoBM [N [REPS]]
+ *
+ * Evaluates, with eval_v(), an expression costing about N (default
+ * 100000) steps, REPS times (default 1000), with memoization off and
+ * then on. Printed: the time per round, each way, and memo_stats().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = (1 < argc) ? atol(argv[1]) : 100000;
+	size_t reps = (2 < argc) ? atol(argv[2]) : 1000;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+	ev->eval("(use-modules (opencog))");
+	std::string expr = "(Concept (number->string (length (iota " +
+		std::to_string(n) + "))))";
+
+	for (bool memo : {false, true})
+	{
+		ev->set_memoize(memo);
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < reps; i++)
+			ev->eval_v(expr);
+		printf("%-12s %12.3f us/round\n", memo ? "memo on" : "memo off",
+		       usecs_since(start) / reps);
+	}
+	ev->set_memoize(false);
+	printf("%s\n", SchemeEval::memo_stats().c_str());
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,89 @@
+/*
+ * SchemePipelineBM.cc
+ *
+ * Throughput of shell-style evaluation, one expression at a time,
+ * against pipelined, with many expressions in flight.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemePipelineBM [DEPTH [REPS]]
+ *
+ * Evaluates a small expression REPS times (default 10000): first with
+ * begin_eval(), eval_expr() and poll_result() in turn, and then with
+ * one thread calling submit_expr() and another next_result(), through
+ * a pipeline DEPTH (default 4) deep.
+ * Printed: the time per expression, each way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* what, double usecs, size_t reps)
+{
+	printf("%-20s %12.3f us/expr\n", what, usecs / reps);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t depth = (1 < argc) ? atol(argv[1]) : 4;
+	size_t reps = (2 < argc) ? atol(argv[2]) : 10000;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+	const char* expr = "(length (iota 1000))";
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+	{
+		ev->begin_eval();
+		ev->eval_expr(expr);
+		ev->poll_result();
+	}
+	report("serial", usecs_since(start), reps);
+
+	ev->set_pipeline_depth(depth);
+	start = std::chrono::steady_clock::now();
+	std::thread producer([&]() {
+		for (size_t i = 0; i < reps; i++)
+			ev->submit_expr(expr);
+	});
+	std::string result;
+	for (size_t i = 0; i < reps; i++)
+		ev->next_result(result);
+	producer.join();
+	report("pipelined", usecs_since(start), reps);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,97 @@
+/*
+ * SchemePollBM.cc
+ *
+ * Cost of fetching a large shell-style result: as a std::string, in
+ * chunks through a caller's buffer, and borrowed in place.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemePollBM [N [REPS]]
+ *
+ * Evaluates an expression printing N bytes (default 1MB), REPS times
+ * (default 1000) for each way of fetching the result: poll_result(),
+ * poll_result() into a fixed 64KB buffer, and poll_result_borrow().
+ * Printed: the time per round, each way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* what, double usecs, size_t reps)
+{
+	printf("%-20s %12.3f us/round\n", what, usecs / reps);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = (1 < argc) ? atol(argv[1]) : 1024 * 1024;
+	size_t reps = (2 < argc) ? atol(argv[2]) : 1000;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+	std::string expr = "(display (make-string " + std::to_string(n) +
+		" #\\x))";
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+	{
+		ev->begin_eval();
+		ev->eval_expr(expr);
+		ev->poll_result();
+	}
+	report("std::string", usecs_since(start), reps);
+
+	std::vector<char> buf(64 * 1024);
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+	{
+		ev->begin_eval();
+		ev->eval_expr(expr);
+		while (0 < ev->poll_result(buf.data(), buf.size())) {}
+	}
+	report("64KB buffer", usecs_since(start), reps);
+
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+	{
+		ev->begin_eval();
+		ev->eval_expr(expr);
+		size_t len;
+		ev->poll_result_borrow(len);
+	}
+	report("borrowed", usecs_since(start), reps);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,93 @@
+/*
+ * SchemeSnapshotBM.cc
+ *
+ * Cost of setting up a new evaluator with a prelude: evaluating the
+ * prelude afresh, against starting from a snapshot of it.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeSnapshotBM [N [REPS]]
+ *
+ * The prelude defines N (default 1000) helper procedures. A fresh
+ * evaluator is made REPS times (default 100), and either evaluates the
+ * prelude, or calls use_environment() on a snapshot of it; either way,
+ * it then calls one of the helpers.
+ * Printed: the time per new evaluator, each way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* what, double usecs, size_t reps)
+{
+	printf("%-20s %12.3f us/evaluator\n", what, usecs / reps);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = (1 < argc) ? atol(argv[1]) : 1000;
+	size_t reps = (2 < argc) ? atol(argv[2]) : 100;
+
+	std::string prelude = "(use-modules (opencog) (srfi srfi-1))";
+	for (size_t i = 0; i < n; i++)
+	{
+		std::string is = std::to_string(i);
+		prelude += "(define (helper-" + is + " x) (+ x " + is + "))";
+	}
+	std::string call = "(helper-" + std::to_string(n - 1) + " 1)";
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+	ev->snapshot_environment("bm-prelude", prelude);
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+	{
+		SchemeEval fresh(as);
+		fresh.eval(prelude);
+		fresh.eval(call);
+	}
+	report("prelude", usecs_since(start), reps);
+
+	start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < reps; i++)
+	{
+		SchemeEval fresh(as);
+		fresh.use_environment("bm-prelude");
+		fresh.eval(call);
+	}
+	report("snapshot", usecs_since(start), reps);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
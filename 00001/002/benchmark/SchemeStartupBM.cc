@@ -0,0 +1,97 @@
+/*
+ * SchemeStartupBM.cc
+ *
+ * Time from process start to the first evaluation, booting guile cold,
+ * and with the boot started early by prewarm().
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeStartupBM [HEAD_START_MS [HEAP_MB]]
+ *
+ * Only the first boot of guile in a process can be timed, so each case
+ * runs in a child process of its own:
+ *   cold       init_scheme() then the first eval, with the bdwgc
+ *              default heap (HEAP_MB of zero);
+ *   sized      the same, with an initial heap of HEAP_MB (default 32);
+ *   prewarmed  prewarm(), then HEAD_START_MS (default 200) of other
+ *              work, then init_scheme() and the first eval.
+ *
+ * Printed: the time to the first eval, and how much of it was spent
+ * waiting in init_scheme(). The cold and sized cases run with guile's
+ * default auto-compile setting; the prewarmed case turns it off.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <thread>
+
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double msecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void boot(const char* what, size_t heap, bool warm, size_t head_ms)
+{
+	auto start = std::chrono::steady_clock::now();
+	SchemeEval::set_startup_heap(heap);
+	if (warm)
+	{
+		SchemeEval::set_auto_compile(false);
+		SchemeEval::prewarm();
+		// Stand-in for whatever else the application does at startup.
+		std::this_thread::sleep_for(std::chrono::milliseconds(head_ms));
+	}
+	auto wait = std::chrono::steady_clock::now();
+	SchemeEval::init_scheme();
+	SchemeEval ev;
+	ev.eval("(+ 1 2)");
+
+	printf("%-10s %10.3f ms to first eval, %.3f ms in init_scheme\n",
+	       what, msecs_since(start), msecs_since(wait));
+	fflush(stdout);
+}
+
+static void in_child(const char* what, size_t heap, bool warm, size_t head_ms)
+{
+	pid_t pid = fork();
+	if (0 == pid) { boot(what, heap, warm, head_ms); _exit(0); }
+	waitpid(pid, nullptr, 0);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t head_ms = (1 < argc) ? atol(argv[1]) : 200;
+	size_t heap = ((2 < argc) ? atol(argv[2]) : 32) * 1024 * 1024;
+
+	in_child("cold", 0, false, 0);
+	in_child("sized", heap, false, 0);
+	in_child("prewarmed", heap, true, head_ms);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,88 @@
+/*
+ * SchemeStructuredBM.cc
+ *
+ * Shell throughput with text results, against structured (JSON)
+ * results.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeStructuredBM [N [REPS]]
+ *
+ * Evaluates an expression that prints N bytes (default 16) and returns
+ * a short list, REPS times (default 10000), with begin_eval(),
+ * eval_expr() and poll_result(): first as text, then as JSON.
+ * Printed: the time per round, each way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/guile/SchemeEval.h>
+
+using namespace opencog;
+
+static double usecs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void report(const char* what, double usecs, size_t reps)
+{
+	printf("%-20s %12.3f us/round\n", what, usecs / reps);
+}
+
+static void shell_rounds(SchemeEval* ev, const std::string& expr,
+                         size_t reps)
+{
+	for (size_t i = 0; i < reps; i++)
+	{
+		ev->begin_eval();
+		ev->eval_expr(expr);
+		ev->poll_result();
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	size_t n = (1 < argc) ? atol(argv[1]) : 16;
+	size_t reps = (2 < argc) ? atol(argv[2]) : 10000;
+
+	AtomSpacePtr as = createAtomSpace();
+	SchemeEval* ev = SchemeEval::get_evaluator(as);
+	std::string expr = "(display (make-string " + std::to_string(n) +
+		" #\\\")) (list 1 2.5 \"three\")";
+
+	auto start = std::chrono::steady_clock::now();
+	shell_rounds(ev, expr, reps);
+	report("text", usecs_since(start), reps);
+
+	ev->set_structured_results(true);
+	start = std::chrono::steady_clock::now();
+	shell_rounds(ev, expr, reps);
+	report("JSON", usecs_since(start), reps);
+	ev->set_structured_results(false);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
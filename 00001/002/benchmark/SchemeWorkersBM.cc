@@ -0,0 +1,146 @@
+/*
+ * SchemeWorkersBM.cc
+ *
+ * Throughput of forked worker processes, compared to a single process
+ * with the same number of evaluator threads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/*
+ * Usage:
+ *   SchemeWorkersBM workers|threads K REQUESTS [EXPR [WARMUP]]
+ *
+ * "workers" starts K worker processes with SchemeWorkers, and drives
+ * them from K client threads, over the socket. "threads" starts K
+ * threads in this process, each with its own evaluator. Each client
+ * (or thread) evaluates EXPR, REQUESTS times. The default EXPR
+ * allocates, so that garbage collection is part of what is measured.
+ * WARMUP, if given, is evaluated once by each worker (or thread)
+ * before the first request, e.g. "(use-modules (opencog exec))".
+ *
+ * Printed: the time until the first reply (worker start-up, or guile
+ * boot, plus the warm-up), and the requests per second once running.
+ * Workers are not forked from a warmed guile (see SchemeWorkers.h), so
+ * the first number is also what each worker restart costs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencog/guile/SchemeEval.h>
+#include <opencog/guile/SchemeWorkers.h>
+
+using namespace opencog;
+
+static const char* default_expr =
+	"(length (map (lambda (i) (* i 1.5)) (iota 10000)))";
+
+static double secs_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+static void run_workers(size_t k, size_t nreq, const std::string& expr,
+                        const std::string& warmup)
+{
+	std::string sock = "/tmp/scheme-workers-bm." + std::to_string(getpid());
+
+	// Must come first: the process has to be single-threaded.
+	auto boot = std::chrono::steady_clock::now();
+	SchemeWorkers workers(sock, k, nullptr, warmup);
+	workers.start();
+
+	// Poll until some worker answers.
+	while (true)
+	{
+		try { SchemeWorkers::eval(sock, expr); break; }
+		catch (...) { usleep(1000); }
+	}
+	printf("workers: first reply after %.3f s\n", secs_since(boot));
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> clients;
+	for (size_t i = 0; i < k; i++)
+		clients.emplace_back([&]() {
+			for (size_t j = 0; j < nreq; j++)
+				SchemeWorkers::eval(sock, expr);
+		});
+	for (auto& t : clients) t.join();
+
+	double secs = secs_since(start);
+	printf("workers: K=%zu %zu requests in %.3f s = %.1f req/s\n",
+	       k, k * nreq, secs, k * nreq / secs);
+	workers.stop();
+}
+
+static void run_threads(size_t k, size_t nreq, const std::string& expr,
+                        const std::string& warmup)
+{
+	auto boot = std::chrono::steady_clock::now();
+	SchemeEval::init_scheme();
+	if (not warmup.empty())
+		SchemeEval::get_evaluator(nullptr)->eval(warmup);
+	printf("threads: guile booted after %.3f s\n", secs_since(boot));
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> evals;
+	for (size_t i = 0; i < k; i++)
+		evals.emplace_back([&]() {
+			SchemeEval* ev = SchemeEval::get_evaluator(nullptr);
+			for (size_t j = 0; j < nreq; j++)
+			{
+				ev->begin_eval();
+				ev->eval_expr(expr);
+				ev->poll_result();
+			}
+		});
+	for (auto& t : evals) t.join();
+
+	double secs = secs_since(start);
+	printf("threads: K=%zu %zu requests in %.3f s = %.1f req/s\n",
+	       k, k * nreq, secs, k * nreq / secs);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 4)
+	{
+		fprintf(stderr, "Usage: %s workers|threads K REQUESTS "
+		        "[EXPR [WARMUP]]\n", argv[0]);
+		return 1;
+	}
+	size_t k = atoi(argv[2]);
+	size_t nreq = atoi(argv[3]);
+	std::string expr = (4 < argc) ? argv[4] : default_expr;
+	std::string warmup = (5 < argc) ? argv[5] : "";
+
+	if (0 == strcmp(argv[1], "workers"))
+		run_workers(k, nreq, expr, warmup);
+	else
+		run_threads(k, nreq, expr, warmup);
+	return 0;
+}
+
+/* ===================== END OF FILE ============================ */
@@ -0,0 +1,20 @@
+;
+; opencog/autoload.scm
+;
+; The autoload manifest for the modules of this package. SchemeEval
+; reads every file of this name found on the guile %load-path, while
+; guile boots. Each entry names a module, followed by the bindings
+; that it provides; the first reference to any of those bindings loads
+; the module. Packages that install more modules install a manifest of
+; their own, in the same form, under their own load-path directory.
+;
+((opencog exec) cog-execute! cog-evaluate!)
+((opencog persist) cog-open cog-close cog-connected?
+   store-atom fetch-atom fetch-incoming-set
+   load-atomspace store-atomspace barrier)
+((opencog persist-file) load-file)
+((opencog logger) cog-logger-info cog-logger-warn
+   cog-logger-error cog-logger-debug cog-logger-set-level!
+   cog-logger-set-filename!)
+((opencog randgen) cog-randgen-set-seed! cog-randgen-randint
+   cog-randgen-randfloat)